@@ -0,0 +1,1004 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
+#include <iomanip>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Format.h"
+#include "FormatBatch.h"
+#include "FormatBinaryLog.h"
+#include "FormatLogger.h"
+#include "FormatStream.h"
+#include "FormatTemplate.h"
+#include "FormatVariadic.h"
+
+// 统计全局 operator new 的调用次数和字节数，用于报告每次操作的内存分配。
+// 替换后的 operator new/delete 就是 malloc/free 的包装，-O3 内联后 GCC 会把
+// 两者配对检查并误报 -Wmismatched-new-delete，这里局部关闭该警告。
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<size_t> g_allocations{0};
+static std::atomic<size_t> g_allocated_bytes{0};
+
+auto operator new(size_t size) -> void* {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t /*size*/) noexcept { std::free(p); }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace {
+
+// 命令行选项：
+//   --json        每个结果输出一行 JSON，便于脚本收集和对比
+//   --filter=STR  只运行名称包含 STR 的基准
+struct Options {
+  bool json = false;
+  std::string filter;
+};
+
+Options g_options;
+
+auto Enabled(std::string_view name) -> bool {
+  return name.find(g_options.filter) != std::string_view::npos;
+}
+
+// 一个结果中的一项指标。key 用于 JSON 输出，unit 用于文本输出。
+struct Metric {
+  const char* key;
+  double value;
+  const char* unit;
+};
+
+void Report(std::string_view name, std::initializer_list<Metric> metrics) {
+  if (g_options.json) {
+    std::string line = "{\"name\":\"";
+    for (char c : name) {
+      if (c == '"' || c == '\\') {
+        line += '\\';
+      }
+      line += c;
+    }
+    line += '"';
+    for (const auto& m : metrics) {
+      line += Formatv::format(",\"%s\":%.3f", m.key, m.value).str();
+    }
+    std::printf("%s}\n", line.c_str());
+    return;
+  }
+  std::printf("%-44.*s", static_cast<int>(name.size()), name.data());
+  for (const auto& m : metrics) {
+    std::printf(" %10.2f %s", m.value, m.unit);
+  }
+  std::printf("\n");
+}
+
+// 防止编译器把被测代码优化掉。
+template <typename T>
+void DoNotOptimize(const T& value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// 报告每次操作的耗时、内存分配次数和分配的字节数。
+template <typename F>
+void Run(std::string_view name, size_t iterations, F&& f) {
+  if (!Enabled(name)) {
+    return;
+  }
+  for (size_t i = 0; i < iterations / 10; ++i) {
+    f(i);
+  }
+  size_t allocations = g_allocations.load();
+  size_t bytes = g_allocated_bytes.load();
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    f(i);
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  double n = static_cast<double>(iterations);
+  Report(name,
+         {{"ns_per_op", ns / n, "ns/op"},
+          {"allocs_per_op", (g_allocations.load() - allocations) / n,
+           "allocs/op"},
+          {"bytes_per_op", (g_allocated_bytes.load() - bytes) / n, "B/op"}});
+}
+
+// 只能通过 operator<< 输出的类型，走 formatv 的流适配路径。
+struct Point {
+  int x;
+  int y;
+};
+
+auto operator<<(std::ostream& os, const Point& p) -> std::ostream& {
+  return os << '(' << p.x << ", " << p.y << ')';
+}
+
+// 运行期解析格式字符串的开销：短模板、典型日志行和较长的报表行。
+void BenchParse() {
+  constexpr size_t Iterations = 1000000;
+  const char* short_fmt = "{0} {1}";
+  const char* medium_fmt = "request {0} from {1} took {2,8:F2} us ({3:x})";
+  const char* long_fmt =
+      "{0,-12}|{1,10:N}|{2,8}|{3,=16}|{4:x}|{5,-20}|{6:E}|{7}|{8,5}|"
+      "{9,-5} and some trailing literal text to scan through\n";
+
+  for (auto [label, fmt] : {std::make_pair("short", short_fmt),
+                            std::make_pair("medium", medium_fmt),
+                            std::make_pair("long", long_fmt)}) {
+    Run(std::string("parse/ParseFormatString ") + label, Iterations,
+        [&, fmt = fmt](size_t /*i*/) {
+          auto items = Formatv::FormatvObjectBase::ParseFormatString(fmt);
+          DoNotOptimize(items.data());
+        });
+  }
+}
+
+// 单个参数的 formatv().str()，与 snprintf 和 ostringstream 对比。
+void BenchTypes() {
+  constexpr size_t Iterations = 1000000;
+  std::string text = "hello, world";
+  Point point{3, -4};
+  char buffer[64];
+
+  Run("type/int formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0}", static_cast<int>(i)).str();
+    DoNotOptimize(s);
+  });
+  Run("type/int snprintf", Iterations, [&](size_t i) {
+    std::snprintf(buffer, sizeof(buffer), "%d", static_cast<int>(i));
+    DoNotOptimize(buffer);
+  });
+  Run("type/int ostringstream", Iterations, [&](size_t i) {
+    std::ostringstream os;
+    os << static_cast<int>(i);
+    DoNotOptimize(os);
+  });
+
+  Run("type/uint64 x formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0:x}", uint64_t{i} << 20).str();
+    DoNotOptimize(s);
+  });
+  Run("type/uint64 x snprintf", Iterations, [&](size_t i) {
+    std::snprintf(buffer, sizeof(buffer), "0x%llx",
+                  static_cast<unsigned long long>(uint64_t{i} << 20));
+    DoNotOptimize(buffer);
+  });
+
+  Run("type/double formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0}", i * 0.125).str();
+    DoNotOptimize(s);
+  });
+  Run("type/double snprintf %g", Iterations, [&](size_t i) {
+    std::snprintf(buffer, sizeof(buffer), "%g", i * 0.125);
+    DoNotOptimize(buffer);
+  });
+  Run("type/double ostringstream", Iterations, [&](size_t i) {
+    std::ostringstream os;
+    os << i * 0.125;
+    DoNotOptimize(os);
+  });
+
+  Run("type/const char* formatv().str()", Iterations, [&](size_t /*i*/) {
+    auto s = Formatv::formatv("{0}", "hello, world").str();
+    DoNotOptimize(s);
+  });
+  Run("type/std::string formatv().str()", Iterations, [&](size_t /*i*/) {
+    auto s = Formatv::formatv("{0}", text).str();
+    DoNotOptimize(s);
+  });
+  Run("type/std::string snprintf", Iterations, [&](size_t /*i*/) {
+    std::snprintf(buffer, sizeof(buffer), "%s", text.c_str());
+    DoNotOptimize(buffer);
+  });
+
+  Run("type/char formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0}", static_cast<char>('a' + i % 26)).str();
+    DoNotOptimize(s);
+  });
+
+  Run("type/pointer formatv().str()", Iterations, [&](size_t /*i*/) {
+    auto s = Formatv::formatv("{0}", static_cast<const void*>(&point)).str();
+    DoNotOptimize(s);
+  });
+
+  // 16 个整数的容器：一次 formatv 与逐个元素调用 formatv 拼接的对比。
+  std::vector<int> values(16);
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = static_cast<int>(i * 37);
+  }
+  Run("type/vector<int> formatv().str()", Iterations, [&](size_t /*i*/) {
+    auto s = Formatv::formatv("{0}", values).str();
+    DoNotOptimize(s);
+  });
+  Run("type/vector<int> per-element formatv", Iterations, [&](size_t /*i*/) {
+    std::string s;
+    for (size_t k = 0; k < values.size(); ++k) {
+      s += Formatv::formatv(k == 0 ? "{0}" : ", {0}", values[k]).str();
+    }
+    DoNotOptimize(s);
+  });
+
+  Run("type/operator<< formatv().str()", Iterations, [&](size_t /*i*/) {
+    auto s = Formatv::formatv("{0}", point).str();
+    DoNotOptimize(s);
+  });
+  Run("type/operator<< ostringstream", Iterations, [&](size_t /*i*/) {
+    std::ostringstream os;
+    os << point;
+    DoNotOptimize(os);
+  });
+}
+
+// 通过 FormatAlign 输出的对齐字段。整数提供 formatted_size，直接填充；
+// 浮点数和流适配的类型先格式化到临时缓冲区再计算填充。
+void BenchAlign() {
+  constexpr size_t Iterations = 1000000;
+  Point point{3, -4};
+  char buffer[64];
+
+  Run("align/int right formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0,10}", i).str();
+    DoNotOptimize(s);
+  });
+  Run("align/int right snprintf", Iterations, [&](size_t i) {
+    std::snprintf(buffer, sizeof(buffer), "%10zu", i);
+    DoNotOptimize(buffer);
+  });
+
+  Run("align/int center formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0,*=12}", i).str();
+    DoNotOptimize(s);
+  });
+
+  Run("align/string left formatv().str()", Iterations, [&](size_t /*i*/) {
+    auto s = Formatv::formatv("{0,-16}", "name").str();
+    DoNotOptimize(s);
+  });
+  Run("align/string left snprintf", Iterations, [&](size_t /*i*/) {
+    std::snprintf(buffer, sizeof(buffer), "%-16s", "name");
+    DoNotOptimize(buffer);
+  });
+
+  Run("align/double F2 formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0,12:F2}", i * 0.125).str();
+    DoNotOptimize(s);
+  });
+  Run("align/double F2 snprintf", Iterations, [&](size_t i) {
+    std::snprintf(buffer, sizeof(buffer), "%12.2f", i * 0.125);
+    DoNotOptimize(buffer);
+  });
+  Run("align/double F2 ostringstream", Iterations, [&](size_t i) {
+    std::ostringstream os;
+    os << std::fixed << std::setprecision(2) << std::setw(12) << i * 0.125;
+    DoNotOptimize(os);
+  });
+
+  Run("align/operator<< center formatv().str()", Iterations,
+      [&](size_t /*i*/) {
+        auto s = Formatv::formatv("{0,=16}", point).str();
+        DoNotOptimize(s);
+      });
+}
+
+// Format.h 的 printf 风格接口 FormatObject::Print 写入调用者的缓冲区。
+void BenchPrint() {
+  constexpr size_t Iterations = 1000000;
+  const char* name = "request";
+  char buffer[256];
+
+  Run("print/FormatObject::Print", Iterations, [&](size_t i) {
+    unsigned n = Formatv::format("%s %d took %.2f us", name,
+                                 static_cast<int>(i), i * 0.25)
+                     .Print(buffer, sizeof(buffer));
+    DoNotOptimize(n);
+    DoNotOptimize(buffer);
+  });
+
+  Run("print/snprintf", Iterations, [&](size_t i) {
+    int n = std::snprintf(buffer, sizeof(buffer), "%s %d took %.2f us", name,
+                          static_cast<int>(i), i * 0.25);
+    DoNotOptimize(n);
+    DoNotOptimize(buffer);
+  });
+
+  Run("print/ostringstream", Iterations, [&](size_t i) {
+    std::ostringstream os;
+    os << name << ' ' << static_cast<int>(i) << " took " << std::fixed
+       << std::setprecision(2) << i * 0.25 << " us";
+    DoNotOptimize(os);
+  });
+
+  Run("print/formatv sink", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::formatv("{0} {1} took {2:F2} us", name, static_cast<int>(i),
+                     i * 0.25)
+        .format(sink);
+    DoNotOptimize(buffer);
+  });
+}
+
+auto MakeIntegers(size_t count) -> std::vector<int64_t> {
+  std::mt19937_64 rng(42);
+  std::vector<int64_t> values(count);
+  for (auto& v : values) {
+    // 让数字的位数分布在 1 到 19 位之间。
+    v = static_cast<int64_t>(rng() >> (rng() % 60)) * ((rng() & 1) ? 1 : -1);
+  }
+  return values;
+}
+
+void BenchIntegers() {
+  constexpr size_t Iterations = 1000000;
+  auto values = MakeIntegers(1024);
+
+  Run("integer/ostream", Iterations, [&](size_t i) {
+    std::ostringstream os;
+    os << values[i % values.size()];
+    DoNotOptimize(os);
+  });
+
+  Run("integer/snprintf", Iterations, [&](size_t i) {
+    char buffer[32];
+    int n = std::snprintf(buffer, sizeof(buffer), "%lld",
+                          static_cast<long long>(values[i % values.size()]));
+    DoNotOptimize(n);
+    DoNotOptimize(buffer);
+  });
+
+  Run("integer/provider", Iterations, [&](size_t i) {
+    char buffer[32];
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::FormatProvider<int64_t>::format(values[i % values.size()], sink,
+                                             "");
+    DoNotOptimize(buffer);
+  });
+
+  Run("integer/provider x", Iterations, [&](size_t i) {
+    char buffer[32];
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::FormatProvider<int64_t>::format(values[i % values.size()], sink,
+                                             "x");
+    DoNotOptimize(buffer);
+  });
+
+  Run("integer/provider N", Iterations, [&](size_t i) {
+    char buffer[32];
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::FormatProvider<int64_t>::format(values[i % values.size()], sink,
+                                             "N");
+    DoNotOptimize(buffer);
+  });
+
+  Run("integer/formatv().str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("{0}", values[i % values.size()]).str();
+    DoNotOptimize(s);
+  });
+}
+
+auto MakeDoubles(size_t count) -> std::vector<double> {
+  std::mt19937_64 rng(7);
+  std::uniform_real_distribution<double> mantissa(-1.0, 1.0);
+  std::uniform_int_distribution<int> exponent(-20, 20);
+  std::vector<double> values(count);
+  for (auto& v : values) {
+    v = mantissa(rng) * std::pow(10.0, exponent(rng));
+  }
+  return values;
+}
+
+void BenchDoubles() {
+  constexpr size_t Iterations = 1000000;
+  auto values = MakeDoubles(1024);
+
+  Run("double/ostream", Iterations, [&](size_t i) {
+    std::ostringstream os;
+    os << values[i % values.size()];
+    DoNotOptimize(os);
+  });
+
+  Run("double/snprintf %.17g", Iterations, [&](size_t i) {
+    char buffer[64];
+    int n = std::snprintf(buffer, sizeof(buffer), "%.17g",
+                          values[i % values.size()]);
+    DoNotOptimize(n);
+    DoNotOptimize(buffer);
+  });
+
+  Run("double/snprintf %.2f", Iterations, [&](size_t i) {
+    char buffer[512];
+    int n = std::snprintf(buffer, sizeof(buffer), "%.2f",
+                          values[i % values.size()]);
+    DoNotOptimize(n);
+    DoNotOptimize(buffer);
+  });
+
+  Run("double/provider shortest", Iterations, [&](size_t i) {
+    char buffer[64];
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::FormatProvider<double>::format(values[i % values.size()], sink,
+                                            "");
+    DoNotOptimize(buffer);
+  });
+
+  Run("double/provider F2", Iterations, [&](size_t i) {
+    char buffer[64];
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::FormatProvider<double>::format(values[i % values.size()], sink,
+                                            "F2");
+    DoNotOptimize(buffer);
+  });
+
+  Run("double/provider E", Iterations, [&](size_t i) {
+    char buffer[64];
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::FormatProvider<double>::format(values[i % values.size()], sink,
+                                            "E");
+    DoNotOptimize(buffer);
+  });
+}
+
+void BenchArguments() {
+  constexpr size_t Iterations = 1000000;
+  std::string name(64, 'n');
+  std::string value(256, 'v');
+  char buffer[512];
+
+  Run("args/formatv copy", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::formatv("{0}={1} #{2}", std::string(name), std::string(value), i)
+        .format(sink);
+    DoNotOptimize(buffer);
+  });
+
+  Run("args/formatv lvalue", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::formatv("{0}={1} #{2}", name, value, i).format(sink);
+    DoNotOptimize(buffer);
+  });
+
+  Run("args/formatv_ref", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::formatv_ref("{0}={1} #{2}", name, value, i).format(sink);
+    DoNotOptimize(buffer);
+  });
+
+  Run("args/vformat_to", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::vformat_to(sink, "{0}={1} #{2}",
+                        Formatv::make_format_args(name, value, i));
+    DoNotOptimize(buffer);
+  });
+
+  Run("args/formatv_ref().str()", Iterations, [&](size_t i) {
+    std::string s = Formatv::formatv_ref("{0}={1} #{2}", name, value, i).str();
+    DoNotOptimize(s);
+  });
+
+  Run("args/formatv_ref().pooled_str()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv_ref("{0}={1} #{2}", name, value, i).pooled_str();
+    DoNotOptimize(s);
+  });
+
+  // 典型的短消息：结果小于内联缓冲区时不分配内存。
+  Run("args/short str()", Iterations, [&](size_t i) {
+    std::string s = Formatv::formatv("request {0} took {1} us", i, 12.5).str();
+    DoNotOptimize(s);
+  });
+
+  Run("args/short to<SmallString<128>>()", Iterations, [&](size_t i) {
+    auto s = Formatv::formatv("request {0} took {1} us", i, 12.5)
+                 .to<Formatv::SmallString<128>>();
+    DoNotOptimize(s);
+  });
+}
+
+void BenchTemplate() {
+  constexpr size_t Iterations = 1000000;
+  std::string name = "exporter";
+  char buffer[256];
+  const char* fmt = "{0,-12}|{1,10:N}|{2,8}|{3}\n";
+  Formatv::FormatTemplate row(fmt);
+
+  Run("template/formatv", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::formatv(fmt, name, i, 2.5, 'x').format(sink);
+    DoNotOptimize(buffer);
+  });
+
+  Run("template/formatv_ref", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    Formatv::formatv_ref(fmt, name, i, 2.5, 'x').format(sink);
+    DoNotOptimize(buffer);
+  });
+
+  Run("template/FormatTemplate", Iterations, [&](size_t i) {
+    Formatv::FixedBufferSink sink(buffer, sizeof(buffer));
+    row(sink, name, i, 2.5, 'x');
+    DoNotOptimize(buffer);
+  });
+}
+
+struct Record {
+  std::string name;
+  int64_t count;
+  double ratio;
+};
+
+auto MakeRecords(size_t count) -> std::vector<Record> {
+  std::mt19937_64 rng(11);
+  std::vector<Record> records(count);
+  for (auto& r : records) {
+    r.name = "item-" + std::to_string(rng() % 100000);
+    r.count = static_cast<int64_t>(rng() % 10000000);
+    r.ratio = static_cast<double>(rng() % 10000) / 100;
+  }
+  return records;
+}
+
+void BenchBatch() {
+  constexpr size_t Rows = 10000;
+  constexpr size_t Iterations = 100;
+  auto records = MakeRecords(Rows);
+  const char* fmt = "{0,-12}|{1,10:N}|{2,8}\n";
+  Formatv::FormatTemplate row(fmt);
+  auto project = [](const Record& r) {
+    return std::forward_as_tuple(r.name, r.count, r.ratio);
+  };
+
+  // 每次操作格式化 Rows 行，以每行的耗时报告。
+  auto run_rows = [&](const char* name, auto&& f) {
+    if (!Enabled(name)) {
+      return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < Iterations; ++i) {
+      f();
+    }
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    Report(name, {{"ns_per_row", ns / (Iterations * Rows), "ns/row"}});
+  };
+
+  run_rows("batch/ostringstream formatv per row", [&] {
+    std::ostringstream os;
+    for (const auto& r : records) {
+      os << Formatv::formatv(fmt, r.name, r.count, r.ratio);
+    }
+    DoNotOptimize(os);
+  });
+
+  run_rows("batch/str() per row", [&] {
+    std::string out;
+    for (const auto& r : records) {
+      out += Formatv::formatv(fmt, r.name, r.count, r.ratio).str();
+    }
+    DoNotOptimize(out.data());
+  });
+
+  run_rows("batch/format_batch_str", [&] {
+    std::string out = Formatv::format_batch_str(row, records, project);
+    DoNotOptimize(out.data());
+  });
+
+  Formatv::BatchOptions options;
+  options.auto_width = true;
+  run_rows("batch/format_batch_str auto width", [&] {
+    std::string out =
+        Formatv::format_batch_str(row, records, project, options);
+    DoNotOptimize(out.data());
+  });
+}
+
+void BenchParallel() {
+  constexpr size_t Rows = 1000000;
+  auto records = MakeRecords(Rows);
+  Formatv::FormatTemplate row("{0,-12}|{1,10:N}|{2,8}\n");
+  auto project = [](const Record& r) {
+    return std::forward_as_tuple(r.name, r.count, r.ratio);
+  };
+
+  if (!Enabled("parallel/")) {
+    return;
+  }
+  size_t max_threads =
+      std::max<size_t>(4, std::thread::hardware_concurrency());
+  double base = 0;
+  for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+    Formatv::ParallelOptions parallel;
+    parallel.threads = threads;
+    auto start = std::chrono::steady_clock::now();
+    std::string out =
+        Formatv::format_batch_parallel_str(row, records, project, parallel);
+    auto end = std::chrono::steady_clock::now();
+    DoNotOptimize(out.data());
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    if (threads == 1) {
+      base = ns;
+    }
+    std::string name = "parallel/" + std::to_string(threads) + " threads";
+    Report(name, {{"ns_per_row", ns / Rows, "ns/row"},
+                  {"speedup", base / ns, "x"}});
+  }
+}
+
+// 写文件：std::ofstream 与直接写 fd 或内存映射的 sink 对比。
+// 负载有两种：格式化报表，以及只复制现成的 64 字节行，
+// 后者只反映输出路径本身的开销。每次都写到新截断的文件，包括最后的刷新。
+void BenchFile() {
+  constexpr size_t Rows = 1000000;
+  auto records = MakeRecords(Rows);
+  const char* fmt = "{0,-12}|{1,10:N}|{2,8}\n";
+  Formatv::FormatTemplate row(fmt);
+  auto project = [](const Record& r) {
+    return std::forward_as_tuple(r.name, r.count, r.ratio);
+  };
+  std::string line(63, 'x');
+  line += '\n';
+  const char* dir = std::getenv("TMPDIR");
+  std::string path = std::string(dir != nullptr ? dir : "/tmp") +
+                     "/formatv_bench." + std::to_string(::getpid());
+
+  auto run_file = [&](const std::string& name, auto&& f) {
+    if (!Enabled(name)) {
+      return;
+    }
+    f();  // 预热页缓存。
+    auto start = std::chrono::steady_clock::now();
+    size_t bytes = f();
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    Report(name, {{"gb_per_s", bytes / ns, "GB/s"},
+                  {"ns_per_row", ns / Rows, "ns/row"}});
+  };
+
+  // 以同一个负载分别测试每种输出方式。
+  auto run_sinks = [&](const char* load, auto&& produce, auto&& to_ofstream) {
+    std::string prefix = std::string("file/") + load + " ";
+    auto open_fd = [&](int flags) {
+      return ::open(path.c_str(), flags | O_CREAT | O_TRUNC, 0644);
+    };
+
+    run_file(prefix + "ofstream", [&] {
+      std::ofstream out(path, std::ios::binary | std::ios::trunc);
+      to_ofstream(out);
+      out.flush();
+      return static_cast<size_t>(out.tellp());
+    });
+
+    run_file(prefix + "ChunkedSink FdWriter", [&] {
+      int fd = open_fd(O_WRONLY);
+      Formatv::FdWriter writer(fd);
+      Formatv::ChunkedSink sink(writer);
+      produce(sink);
+      sink.Flush();
+      ::close(fd);
+      return sink.count();
+    });
+
+    run_file(prefix + "FdSink", [&] {
+      int fd = open_fd(O_WRONLY);
+      Formatv::FdSink sink(fd);
+      produce(sink);
+      sink.Flush();
+      ::close(fd);
+      return sink.count();
+    });
+
+    run_file(prefix + "MmapSink", [&] {
+      int fd = open_fd(O_RDWR);
+      Formatv::MmapSink sink(fd);
+      produce(sink);
+      sink.Close();
+      ::close(fd);
+      return sink.count();
+    });
+  };
+
+  run_sinks(
+      "report",
+      [&](Formatv::FormatSink& sink) {
+        Formatv::format_batch(sink, row, records, project);
+      },
+      [&](std::ofstream& out) {
+        for (const auto& r : records) {
+          out << Formatv::formatv(fmt, r.name, r.count, r.ratio);
+        }
+      });
+
+  run_sinks(
+      "copy 64B",
+      [&](Formatv::FormatSink& sink) {
+        for (size_t i = 0; i < Rows; ++i) {
+          sink.write(line);
+        }
+      },
+      [&](std::ofstream& out) {
+        for (size_t i = 0; i < Rows; ++i) {
+          out.write(line.data(), static_cast<std::streamsize>(line.size()));
+        }
+      });
+
+  ::unlink(path.c_str());
+}
+
+// 逐次计时，报告生产者一侧单次调用延迟的分位数。
+template <typename F>
+void RunLatency(const char* name, size_t iterations, F&& f) {
+  if (!Enabled(name)) {
+    return;
+  }
+  std::vector<double> samples(iterations);
+  for (size_t i = 0; i < iterations; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    f(i);
+    auto end = std::chrono::steady_clock::now();
+    samples[i] = std::chrono::duration<double, std::nano>(end - start).count();
+  }
+  std::sort(samples.begin(), samples.end());
+  auto at = [&](double q) {
+    return samples[std::min(iterations - 1,
+                            static_cast<size_t>(q * iterations))];
+  };
+  Report(name, {{"p50_ns", at(0.5), "ns p50"},
+                {"p99_ns", at(0.99), "ns p99"},
+                {"p999_ns", at(0.999), "ns p99.9"},
+                {"max_ns", samples.back(), "ns max"}});
+}
+
+void BenchLogger() {
+  constexpr size_t Iterations = 200000;
+  std::string user = "user-1234";
+
+  {
+    Formatv::CountingSink sink;
+    RunLatency("logger/sync formatv", Iterations, [&](size_t i) {
+      Formatv::formatv("request {0} from {1} took {2} us", i, user, 12.5)
+          .format(sink);
+      sink.put('\n');
+    });
+  }
+
+  for (auto policy : {Formatv::OverflowPolicy::Drop,
+                      Formatv::OverflowPolicy::Block}) {
+    Formatv::CountingSink sink;
+    Formatv::AsyncLogger<>::Options options;
+    options.capacity = 1 << 16;
+    options.policy = policy;
+    Formatv::AsyncLogger<> logger(sink, options);
+    const char* name = policy == Formatv::OverflowPolicy::Drop
+                           ? "logger/async drop"
+                           : "logger/async block";
+    RunLatency(name, Iterations, [&](size_t i) {
+      logger.log("request {0} from {1} took {2} us", i, user, 12.5);
+    });
+    logger.Flush();
+    if (Enabled(name)) {
+      Report(name, {{"dropped", static_cast<double>(logger.dropped()),
+                     "dropped"}});
+    }
+  }
+}
+
+void BenchBinaryLog() {
+  constexpr size_t Iterations = 1000000;
+  std::string user = "user-1234";
+  std::string data;
+  {
+    Formatv::CountingSink sink;
+    Run("binlog/formatv text", Iterations, [&](size_t i) {
+      Formatv::formatv("request {0} from {1} took {2} us", i, user, 12.5)
+          .format(sink);
+    });
+  }
+  if (!Enabled("binlog/")) {
+    return;
+  }
+  {
+    Formatv::StringSink sink(data);
+    Formatv::BinaryLogWriter writer(sink);
+    Run("binlog/encode", Iterations, [&](size_t i) {
+      writer.log("request {0} from {1} took {2} us", i, user, 12.5);
+    });
+  }
+  {
+    Formatv::CountingSink sink;
+    Formatv::BinaryLogReader reader(data);
+    auto start = std::chrono::steady_clock::now();
+    size_t records = 0;
+    while (reader.Next(sink)) {
+      ++records;
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    double n = static_cast<double>(std::max<size_t>(records, 1));
+    Report("binlog/decode",
+           {{"ns_per_op",
+             std::chrono::duration<double, std::nano>(elapsed).count() / n,
+             "ns/op"}});
+    Report("binlog/encoded size",
+           {{"bytes_per_record", data.size() / n, "B/record"}});
+  }
+}
+
+// printf 风格的 Formatv::format 与直接调用 snprintf 的对比。
+void BenchPrintf() {
+  constexpr size_t Iterations = 1000000;
+  const char* name = "request";
+  char buffer[256];
+
+  Run("printf/snprintf %s %d %x %.2f", Iterations, [&](size_t i) {
+    std::snprintf(buffer, sizeof(buffer), "%s %d %x %.2f", name,
+                  static_cast<int>(i), static_cast<unsigned>(i), i * 0.25);
+    DoNotOptimize(buffer);
+  });
+
+  Run("printf/format().str() %s %d %x %.2f", Iterations, [&](size_t i) {
+    std::string s = Formatv::format("%s %d %x %.2f", name, static_cast<int>(i),
+                                    static_cast<unsigned>(i), i * 0.25)
+                        .str();
+    DoNotOptimize(s);
+  });
+
+  {
+    std::string s;
+    Run("printf/format().append() %s %d %x %.2f", Iterations, [&](size_t i) {
+      s.clear();
+      Formatv::format("%s %d %x %.2f", name, static_cast<int>(i),
+                      static_cast<unsigned>(i), i * 0.25)
+          .append(s);
+      DoNotOptimize(s);
+    });
+  }
+
+  Run("printf/static str() %s %d %x %.2f", Iterations, [&](size_t i) {
+    std::string s = Formatv::format(FORMATV_STR("%s %d %x %.2f"), name,
+                                    static_cast<int>(i),
+                                    static_cast<unsigned>(i), i * 0.25)
+                        .str();
+    DoNotOptimize(s);
+  });
+
+  // 不在快速路径中的转换：一次栈上的 snprintf。
+  Run("printf/snprintf %e", Iterations, [&](size_t i) {
+    std::snprintf(buffer, sizeof(buffer), "%e", i * 0.25);
+    DoNotOptimize(buffer);
+  });
+
+  Run("printf/format().str() %e", Iterations, [&](size_t i) {
+    std::string s = Formatv::format("%e", i * 0.25).str();
+    DoNotOptimize(s);
+  });
+}
+
+// 以 GB/s 报告吞吐量，bytes 是每次操作处理的字节数。
+template <typename F>
+void RunThroughput(const std::string& name, size_t bytes, F&& f) {
+  if (!Enabled(name)) {
+    return;
+  }
+  size_t iterations = std::max<size_t>(1, (size_t(256) << 20) / bytes);
+  for (size_t i = 0; i < iterations / 10; ++i) {
+    f();
+  }
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    f();
+  }
+  auto end = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(end - start).count();
+  Report(name, {{"gb_per_s", bytes * iterations / ns, "GB/s"}});
+}
+
+// 字面量为主、只有少量替换项的长模板，类似报表和 HTML 片段。
+auto MakeTemplate(size_t size) -> std::string {
+  std::string fmt;
+  std::mt19937 rng(7);
+  size_t field = 0;
+  while (fmt.size() < size) {
+    size_t literal = 200 + rng() % 800;
+    for (size_t i = 0; i < literal && fmt.size() < size; ++i) {
+      fmt.push_back(static_cast<char>('a' + rng() % 26));
+    }
+    if (fmt.size() + 8 < size) {
+      fmt += "{" + std::to_string(field++ % 4) + ",-8}";
+    }
+  }
+  return fmt;
+}
+
+void BenchScan() {
+  for (size_t size : {100, 1024, 4096, 16384, 65536}) {
+    std::string fmt = MakeTemplate(size);
+    std::string suffix = "/" + std::to_string(size) + "B";
+
+    // 逐段查找花括号的解析方式，即编译期解析使用的路径。
+    RunThroughput("scan/parse visit" + suffix, fmt.size(), [&] {
+      std::vector<Formatv::ReplacementItem> items;
+      Formatv::FormatvObjectBase::VisitFormatString(
+          fmt, [&](const Formatv::ReplacementItem& i) { items.push_back(i); });
+      DoNotOptimize(items.data());
+    });
+
+    RunThroughput("scan/parse simd" + suffix, fmt.size(), [&] {
+      auto items = Formatv::FormatvObjectBase::ParseFormatString(fmt);
+      DoNotOptimize(items.data());
+    });
+
+    Formatv::Internal::BracePositions braces;
+    for (auto [method, label] :
+         {std::make_pair(Formatv::Internal::ScanMethod::Scalar, "scalar"),
+          std::make_pair(Formatv::Internal::ScanMethod::Sse2, "sse2"),
+          std::make_pair(Formatv::Internal::ScanMethod::Avx2, "avx2")}) {
+      if (method > Formatv::Internal::BestScanMethod()) {
+        continue;
+      }
+      RunThroughput(std::string("scan/braces ") + label + suffix, fmt.size(),
+                    [&, method = method] {
+                      Formatv::Internal::ScanBraces(fmt, braces, method);
+                      DoNotOptimize(braces.opens.data());
+                    });
+    }
+  }
+}
+
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    if (arg == "--json") {
+      g_options.json = true;
+    } else if (arg.substr(0, 9) == "--filter=") {
+      g_options.filter = std::string(arg.substr(9));
+    } else {
+      std::fprintf(stderr, "usage: %s [--json] [--filter=substring]\n",
+                   argv[0]);
+      return 2;
+    }
+  }
+
+  BenchParse();
+  BenchTypes();
+  BenchAlign();
+  BenchPrint();
+  BenchIntegers();
+  BenchDoubles();
+  BenchArguments();
+  BenchPrintf();
+  BenchScan();
+  BenchTemplate();
+  BenchBatch();
+  BenchParallel();
+  BenchFile();
+  BenchLogger();
+  BenchBinaryLog();
+  return 0;
+}
@@ -1,14 +1,56 @@
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <new>
+#include <thread>
 
 #include "Format.h"
+#include "FormatBatch.h"
+#include "FormatBinaryLog.h"
+#include "FormatLogger.h"
+#include "FormatStream.h"
+#include "FormatTemplate.h"
 #include "FormatVariadic.h"
 
+// 统计全局 operator new 的调用次数，用于验证稳态下的格式化不分配内存。
+static std::atomic<size_t> g_allocations{0};
+
+auto operator new(size_t size) -> void* {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t /*size*/) noexcept { std::free(p); }
+
 void test_format() {
   double myfloat = 12.3456789;
   char buffer[256];
   auto fmt = Formatv::format("%0.4f", myfloat);
   fmt.Print(buffer, sizeof(buffer));
   std::cout << buffer << '\n';
+
+  // %d %u %x %s %f 不经过 snprintf；%e 等其他转换退回到 snprintf。
+  std::string line = Formatv::format("%-6s|%5d|%08x|%.2f", "str", -42, 255u,
+                                     myfloat)
+                         .str();
+  Formatv::format(" %e", myfloat).append(line);
+  std::cout << line << '\n';
+
+  // 带精度的 %s 只读取精度范围内的字节，参数可以没有 '\0' 结尾。
+  char tag[4] = {'a', 'b', 'c', 'd'};
+  std::cout << Formatv::format("[%.3s]", tag).str() << '\n';
+
+  // 编译期检查参数个数和类型，例如 format(FORMATV_STR("%s"), 12.3) 无法编译。
+  std::cout << Formatv::format(FORMATV_STR("%-6s|%5d|%lu|%.1f|%c"), "static",
+                               7, 42UL, myfloat, 'z')
+                   .str()
+            << '\n';
 }
 
 void test_formatv_parse() {
@@ -21,17 +63,468 @@ void test_formatv_parse() {
   std::cout << Formatv::formatv("{0}", 1).str() << '\n';
   std::cout << Formatv::formatv("{0}", 'c').str() << '\n';
   std::cout << Formatv::formatv("{0}", -3).str() << '\n';
+  // FormatUtil 的辅助函数接受字符串字面量、std::string_view 和 std::string。
+  using Formatv::FormatUtil;
+  std::string padded = "  pad ";
+  std::cout << FormatUtil::trim("  x ") << FormatUtil::drop_front("abc", 1)
+            << FormatUtil::take_front("abc") << FormatUtil::slice("abcd", 1, 3)
+            << FormatUtil::substr("abc", 2) << FormatUtil::ltrim("..y", ".")
+            << FormatUtil::rtrim("z..", ".")
+            << FormatUtil::take_while("aab", [](char c) { return c == 'a'; })
+            << FormatUtil::find("abc", 'c')
+            << FormatUtil::find_first_of("ab", 'b')
+            << FormatUtil::trim(padded) << FormatUtil::drop_front(padded, 2)
+            << '\n';
+  // int8_t 和 uint8_t 都按数值输出，只有 char 按字符输出。
+  std::cout << Formatv::formatv("{0} {1} {2:x}", int8_t{-5}, uint8_t{200},
+                                int8_t{-1})
+                   .str()
+            << '\n';
   std::cout << Formatv::formatv("{0}", "Test").str() << '\n';
   std::cout << Formatv::formatv("{0}", std::string("Test2")).str() << '\n';
   std::cout << Formatv::formatv("{0} {1}", 1234.412, "test").str() << '\n';
 
   std::cout << Formatv::formatv("{0:N}", 1234567890).str() << '\n';
+  std::cout << Formatv::formatv("{0:x} {0:X-4} {0:b-8}", 42).str() << '\n';
 
   std::cout << Formatv::formatv("{0,=+5}", 123).str() << '\n';
 }
 
+void test_formatv_cache() {
+  auto& cache = Formatv::FormatStringCache::Instance();
+  for (int i = 0; i < 3; ++i) {
+    std::cout << Formatv::formatv("cached {0}", i).str() << '\n';
+  }
+  auto stats = cache.GetStats();
+  std::cout << "hits=" << stats.hits << " misses=" << stats.misses
+            << " entries=" << stats.entries << '\n';
+
+  // 调整容量不会清零命中次数。
+  cache.SetCapacity(Formatv::FormatStringCache::DefaultCapacity);
+  std::cout << "hits after SetCapacity=" << cache.GetStats().hits << '\n';
+}
+
+void test_formatv_static() {
+  std::cout << Formatv::formatv(FORMATV_STR("{0} {1,-6}|{2,=+7:N}"), "static",
+                                'c', 42)
+                   .str()
+            << '\n';
+}
+
+void test_formatv_sink() {
+  char buffer[8];
+  auto result = Formatv::formatv("{0}-{1}", "truncated", 12345)
+                    .format_to_n(buffer, sizeof(buffer));
+  std::cout << std::string(buffer, result.out) << " size=" << result.size
+            << '\n';
+
+  std::string out = "append:";
+  Formatv::formatv(" {0,-4}|", 'x').format_to(std::back_inserter(out));
+  std::cout << out << '\n';
+
+  auto obj = Formatv::formatv("{0,8}|{1}|{2}", "size", 'c', 3.5);
+  std::cout << obj.formatted_size() << " == " << obj.str().size() << '\n';
+}
+
+// 旧版本签名的 FormatProvider，写入 std::ostream。
+struct Legacy {
+  int value;
+};
+
+template <>
+struct Formatv::FormatProvider<Legacy> {
+  static void format(const Legacy& legacy, std::ostream& os,
+                     std::string options) {
+    os << "legacy<" << legacy.value << options << '>';
+  }
+};
+
+void test_formatv_ref() {
+  std::string name = "reference";
+  std::cout << Formatv::formatv_ref("{0,-10}|{1:x}", name, 255).str() << '\n';
+  std::cout << Formatv::formatv("{0,12:!}|", Legacy{7}).str() << '\n';
+
+  auto args = Formatv::make_format_args(name, 2.5, 'r');
+  std::string out;
+  {
+    Formatv::StringSink sink(out);
+    Formatv::vformat_to(sink, std::string_view("{2}:{0} {1}"), args);
+  }
+  std::cout << out << " | " << Formatv::vformatv("{1}", args).str() << '\n';
+}
+
+void test_format_template() {
+  Formatv::FormatTemplate row("{{ {0,-6}|{1,7:N} {2}");
+  std::string out;
+  {
+    Formatv::StringSink sink(out);
+    row(sink, "alpha", 12345, 'a');
+    sink.put('\n');
+    row(sink, "beta", 678, 'b');
+  }
+  std::cout << out << '\n';
+  std::cout << row.str("gamma", 9, 'c') << " fields=" << row.field_count()
+            << " literals=" << row.literal_size() << '\n';
+}
+
+void test_format_batch() {
+  struct Record {
+    std::string name;
+    int count;
+    double ratio;
+  };
+  std::vector<Record> records = {{"alpha", 1, 0.5}, {"beta", 12345, 2.25}};
+  Formatv::FormatTemplate row("|{0,-1}|{1,1:N}|{2,1}|\n");
+  Formatv::BatchOptions options;
+  options.auto_width = true;
+  std::cout << Formatv::format_batch_str(
+      row, records,
+      [](const Record& r) {
+        return std::forward_as_tuple(r.name, r.count, r.ratio);
+      },
+      options);
+}
+
+void test_async_logger() {
+  Formatv::StreamSink sink(std::cout);
+  Formatv::AsyncLogger<> logger(sink);
+  std::string user = "async";
+  logger.log("logger {0} {1:x} {2}", user, 255, 0.25);
+  logger.Flush();
+
+  // 其他线程持续提交、队列始终不空时，Flush() 仍在写完此前的日志后返回。
+  Formatv::CountingSink counter;
+  Formatv::AsyncLogger<32> busy(counter);
+  std::atomic<bool> done{false};
+  std::thread producer([&] {
+    while (!done.load(std::memory_order_relaxed)) {
+      busy.log("busy {0}", 1);
+    }
+  });
+  for (int i = 0; i < 100; ++i) {
+    busy.Flush();
+  }
+  done.store(true, std::memory_order_relaxed);
+  producer.join();
+  // 编码后超过 32 字节的参数先同步格式化，文本仍然放不下时截断。
+  busy.log("long {0}", std::string(100, 'x'));
+  busy.Flush();
+  std::cout << "flushed under load, truncated " << busy.truncated()
+            << std::endl;
+}
+
+// 带选项的自定义 FormatProvider：选项 "u" 输出大写。
+struct Tag {
+  std::string_view name;
+};
+
+template <>
+struct Formatv::FormatProvider<Tag> {
+  static void format(const Tag& tag, FormatSink& os, std::string_view options) {
+    for (char c : tag.name) {
+      os.put(options == "u" && c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c);
+    }
+  }
+};
+
+void test_binary_log() {
+  std::string data;
+  {
+    Formatv::StringSink sink(data);
+    Formatv::BinaryLogWriter writer(sink);
+    writer.log("binary {0} {1:x} {2:F2}", std::string("log"), -2, 0.125);
+    writer.log("binary {0,4}|{1}", 'c', 1u << 31);
+  }
+  std::string text;
+  {
+    Formatv::StringSink sink(text);
+    Formatv::BinaryLogReader reader(data);
+    while (reader.Next(sink)) {
+      sink.put('\n');
+    }
+  }
+  std::string expect =
+      Formatv::formatv("binary {0} {1:x} {2:F2}\n", "log", -2, 0.125).str() +
+      Formatv::formatv("binary {0,4}|{1}\n", 'c', 1u << 31).str();
+  std::cout << text << "binary log identical: " << (text == expect)
+            << std::endl;
+
+  // 范围、自定义类型和函数指针按字段的选项在记录时格式化，
+  // 同一参数可以有不同的选项。
+  std::vector<int> values = {1, 2, 3};
+  Tag tag{"custom"};
+  data.clear();
+  {
+    Formatv::StringSink sink(data);
+    Formatv::BinaryLogWriter writer(sink);
+    writer.log("{0:$[; ]} {0:^[<>]} {1,8:u}|{1} {2}", values, tag,
+               &test_binary_log);
+  }
+  text.clear();
+  {
+    Formatv::StringSink sink(text);
+    Formatv::BinaryLogReader reader(data);
+    reader.Next(sink);
+  }
+  expect = Formatv::formatv("{0:$[; ]} {0:^[<>]} {1,8:u}|{1} {2}", values,
+                            tag, &test_binary_log)
+               .str();
+  std::cout << text << " identical: " << (text == expect) << std::endl;
+
+  // 格式字符串无法解析的日志被跳过，之后的日志照常解码。
+  data = "FMTVLOG1";
+  data += std::string("F\x00\x06", 3) + "bad {0";
+  data += std::string("M\x00\x00", 3);
+  data += std::string("F\x01\x02", 3) + "ok";
+  data += std::string("M\x01\x00", 3);
+  text.clear();
+  size_t skipped;
+  {
+    Formatv::StringSink sink(text);
+    Formatv::BinaryLogReader reader(data);
+    while (reader.Next(sink)) {
+      sink.put(' ');
+    }
+    skipped = reader.skipped();
+  }
+  std::cout << text << "skipped " << skipped << std::endl;
+}
+
+// 只提供 operator<< 的类型，输出长度事先未知。
+struct Banner {
+  std::string_view text;
+};
+
+auto operator<<(std::ostream& os, const Banner& banner) -> std::ostream& {
+  return os << '[' << banner.text << ']';
+}
+
+void test_scratch_memory() {
+  std::string wide(300, 'w');
+  Banner banner{wide};
+  auto run = [&] {
+    // {4,=320} 的输出超过对齐的栈缓冲区，会溢出到 ScratchArena。
+    auto buffer = Formatv::formatv("{0} {1,8:x} {2,-6}|{3,310} {4,=320}", 42,
+                                   255, "left", wide, banner)
+                      .pooled_str();
+    return buffer.size();
+  };
+  // 预热：建立格式字符串缓存、缓冲池和 arena 的内存块。
+  size_t size = run();
+  size_t before = g_allocations.load();
+  for (int i = 0; i < 100; ++i) {
+    size = run();
+  }
+  std::cout << "pooled size " << size << ", steady-state allocations: "
+            << g_allocations.load() - before << std::endl;
+
+  // 一个很宽的字段不经过 arena 缓冲，先计数再直接输出，
+  // arena 保留的内存不超过上限。
+  std::string huge(200000, 'h');
+  Formatv::formatv("{0,=200010}", Banner{huge}).str();
+  auto& arena = Formatv::ScratchArena::ThreadLocal();
+  std::cout << "arena retained " << arena.capacity()
+            << " <= " << Formatv::ScratchArena::MaxRetained << std::endl;
+}
+
+void test_small_string() {
+  using Message = Formatv::SmallString<128>;
+  auto format = [](int i) {
+    return Formatv::formatv("{0} took {1:F1} us", "small", i * 0.5)
+        .to<Message>();
+  };
+  // 第一次调用解析并缓存格式字符串。
+  Message msg = format(0);
+  size_t before = g_allocations.load();
+  for (int i = 1; i < 100; ++i) {
+    msg = format(i);
+  }
+  size_t allocations = g_allocations.load() - before;
+
+  // 结果可以不经复制地作为视图或 formatv 的参数继续传递。
+  Formatv::ArrayRef<char> bytes = msg;
+  std::string_view view = msg;
+  std::cout << Formatv::formatv("[{0,-24}] {1} {2}", msg, bytes.size(),
+                                view == msg)
+                   .str()
+            << std::endl;
+  auto wide = Formatv::formatv("{0,200}", msg).to<Message>();
+  std::cout << "small string allocations: " << allocations
+            << ", inline: " << msg.is_inline() << "/" << wide.is_inline()
+            << std::endl;
+}
+
+void test_format_range() {
+  std::vector<int> ids = {3, 14, 15, 92};
+  const uint8_t packet[] = {0x7f, 0x45, 0x4c, 0x46};
+  std::vector<std::vector<double>> matrix = {{1, 0.5}, {0.25, 2}};
+  std::cout << Formatv::formatv("ids: {0}", ids).str() << std::endl;
+  std::cout << Formatv::formatv("ids: {0:^<[]>$[ | ]@[3]}", ids).str()
+            << std::endl;
+  // ArrayRef 只引用原数据，元素直接写入输出。
+  std::cout << Formatv::formatv("packet: {0:$[ ]@[x-2]}",
+                                Formatv::ArrayRef<uint8_t>(packet))
+                   .str()
+            << std::endl;
+  // 内置数组同样按范围格式化，而不是输出退化后的指针。
+  int primes[] = {2, 3, 5, 7};
+  std::cout << Formatv::formatv("primes: {0:^[()]} packet: {1:$[ ]@[x-2]}",
+                                primes, packet)
+                   .str()
+            << std::endl;
+  std::cout << Formatv::formatv("matrix: {0:^<[]>@($[; ]@[F2])}", matrix)
+                   .str()
+            << std::endl;
+  std::cout << Formatv::formatv("[{0,20:$[/]}]", std::vector<std::string>{
+                                                      "usr", "local", "bin"})
+                   .str()
+            << std::endl;
+}
+
+void test_chunked_sink() {
+  std::vector<int64_t> ids(200000);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i] = static_cast<int64_t>(i * 7919);
+  }
+  Formatv::FormatTemplate row("{0,8}|{1,12:x}|{2,10:N}\n");
+  auto project = [](int64_t id) {
+    return std::make_tuple(id % 1000, id, id * 3);
+  };
+  const char* list_fmt = "{0:$[\n]@[x]}\n";
+
+  // 整个导出过程只使用一个 4KB 的块，回调每次收到不超过一块的数据。
+  size_t total = 0;
+  size_t largest = 0;
+  Formatv::CallbackWriter writer([&](std::string_view chunk) {
+    total += chunk.size();
+    largest = std::max(largest, chunk.size());
+  });
+  size_t allocations = 0;
+  {
+    // 第一次调用解析并缓存格式字符串。
+    Formatv::CountingSink warmup;
+    Formatv::formatv(list_fmt, std::vector<int64_t>()).format(warmup);
+    Formatv::ChunkedSink sink(writer, 4096);
+    size_t before = g_allocations.load();
+    Formatv::format_batch(sink, row, ids, project);
+    Formatv::formatv(list_fmt, ids).format(sink);
+    sink.Flush();
+    allocations = g_allocations.load() - before;
+    std::cout << "chunked: " << total << " bytes in " << sink.chunks()
+              << " chunks, largest " << largest
+              << ", allocations: " << allocations << std::endl;
+  }
+
+  // 同样的输出经过 FILE* 写入临时文件。
+  std::FILE* file = std::tmpfile();
+  {
+    Formatv::FileWriter file_writer(file);
+    Formatv::ChunkedSink sink(file_writer);
+    Formatv::format_batch(sink, row, ids, project);
+    Formatv::formatv(list_fmt, ids).format(sink);
+  }
+  std::cout << "file size matches: " << (std::ftell(file) == long(total))
+            << std::endl;
+  std::fclose(file);
+}
+
+void test_file_sinks() {
+  Formatv::FormatTemplate row("{0,6}|{1,-8}|{2,10:N}\n");
+  std::vector<int> ids(50000);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i] = static_cast<int>(i);
+  }
+  auto project = [](int id) {
+    return std::make_tuple(id, id % 2 == 0 ? "even" : "odd", id * 1000);
+  };
+  std::string expected = Formatv::format_batch_str(row, ids, project);
+
+  // 读回整个文件用于比较。
+  auto read_back = [](int fd) {
+    std::string content(static_cast<size_t>(::lseek(fd, 0, SEEK_END)), '\0');
+    ::pread(fd, content.data(), content.size(), 0);
+    return content;
+  };
+
+  std::FILE* fd_file = std::tmpfile();
+  int fd = ::fileno(fd_file);
+  size_t writes;
+  {
+    Formatv::FdSink sink(fd, 64 * 1024);
+    Formatv::format_batch(sink, row, ids, project);
+    sink.Flush();
+    writes = sink.writes();
+  }
+  std::cout << "FdSink: " << writes << " writes, matches "
+            << (read_back(fd) == expected) << std::endl;
+  std::fclose(fd_file);
+
+  // 以 1MB 的 extent 增长，输出跨越多个映射窗口。
+  std::FILE* map_file = std::tmpfile();
+  fd = ::fileno(map_file);
+  {
+    Formatv::MmapSink sink(fd, 1 << 20);
+    Formatv::format_batch(sink, row, ids, project);
+  }
+  std::cout << "MmapSink: " << expected.size() << " bytes, matches "
+            << (read_back(fd) == expected) << std::endl;
+  std::fclose(map_file);
+}
+
+void test_instrument() {
+  auto& registry = Formatv::InstrumentRegistry::Instance();
+  if (!Formatv::InstrumentRegistry::Enabled) {
+    std::cout << "instrumentation disabled" << std::endl;
+    return;
+  }
+  registry.Reset();
+
+  std::vector<std::pair<std::string, int>> rows = {
+      {"parse", 12}, {"align", 3}, {"output", 40}};
+  std::string out;
+  for (int i = 0; i < 100; ++i) {
+    for (const auto& [name, value] : rows) {
+      out += Formatv::formatv("{0,-8}|{1,6}|{2,=10:F2}\n", name, value,
+                              value * 0.5)
+                 .str();
+    }
+    out += Formatv::formatv("total {0}", i).str();
+  }
+  auto sites = registry.Snapshot();
+  std::cout << registry.DumpText();
+  std::cout << "instrumented sites: " << sites.size()
+            << ", hottest: " << sites.front().fmt << std::endl;
+
+  // 格式字符串释放后地址被另一个格式字符串重用：同一块内存先后存放
+  // 两个模板，两者的调用仍然分别计数。
+  char buffer[] = "first {0}|{1}";
+  auto* first = registry.Site(buffer, std::string_view(buffer));
+  first->Add(first->format_calls, 3);
+  std::memcpy(buffer, "other", 5);
+  auto* second = registry.Site(buffer, std::string_view(buffer));
+  second->Add(second->format_calls, 5);
+  std::cout << "reused address: separate " << (first != second)
+            << ", first " << first->Load().format_calls << " " << first->fmt
+            << ", second " << second->Load().format_calls << " "
+            << second->fmt << std::endl;
+}
+
 auto main() -> int {
   test_format();
   test_formatv_parse();
+  test_formatv_cache();
+  test_formatv_static();
+  test_formatv_sink();
+  test_formatv_ref();
+  test_format_template();
+  test_format_batch();
+  test_async_logger();
+  test_binary_log();
+  test_scratch_memory();
+  test_small_string();
+  test_format_range();
+  test_chunked_sink();
+  test_file_sinks();
+  test_instrument();
   return 0;
 }
\ No newline at end of file
@@ -1,11 +1,25 @@
 #ifndef FORMATV_FORMAT_H
 #define FORMATV_FORMAT_H
 
+#include <array>
 #include <cassert>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
 #include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
 #include <tuple>
+#include <type_traits>
 #include <utility>
 
+#include "FormatProviders.h"
+#include "FormatSink.h"
+#include "FormatVariadicDetails.h"
+
 namespace Formatv {
 
 class FormatObjectBase {
@@ -25,6 +39,58 @@ class FormatObjectBase {
     return n;
   }
 
+  /// Write the formatted text to \p os. Common conversions are rendered
+  /// directly; anything else goes through snprintf into a stack buffer,
+  /// with exactly one retry into a heap buffer of the reported size.
+  void format(FormatSink& os) const {
+    if (fast_format(os)) {
+      return;
+    }
+    char stack[StackSize];
+    int n = snprint(stack, StackSize);
+    if (n < 0) {
+      return;
+    }
+    if (unsigned(n) < StackSize) {
+      os.write(stack, n);
+      return;
+    }
+    std::unique_ptr<char[]> heap(new char[n + 1]);
+    snprint(heap.get(), n + 1);
+    os.write(heap.get(), n);
+  }
+
+  /// Append the formatted text to \p out, e.g. a std::string or SmallString.
+  template <typename String>
+  void append(String& out) const {
+    if (fast_format_to(out)) {
+      return;
+    }
+    char stack[StackSize];
+    int n = snprint(stack, StackSize);
+    if (n < 0) {
+      return;
+    }
+    if (unsigned(n) < StackSize) {
+      out.append(stack, n);
+      return;
+    }
+    // Format in place; the extra byte holds the terminating NUL.
+    size_t size = out.size();
+    out.resize(size + n + 1);
+    snprint(out.data() + size, n + 1);
+    out.resize(size + n);
+  }
+
+  auto str() const -> std::string {
+    std::string result;
+    append(result);
+    return result;
+  }
+
+  /// Size of the stack buffer tried before allocating.
+  static constexpr unsigned StackSize = 256;
+
  protected:
   FormatObjectBase(const FormatObjectBase&) = default;
   ~FormatObjectBase() = default;
@@ -34,7 +100,18 @@ class FormatObjectBase {
   virtual auto snprint(char* buffer, unsigned buffer_size) const
       -> int = 0;
 
+  /// Render without snprintf if every conversion is in the supported subset.
+  /// Returns false, having written nothing, otherwise.
+  virtual auto fast_format(FormatSink& os) const -> bool = 0;
+
   const char* fmt_;
+
+ private:
+  template <typename String>
+  auto fast_format_to(String& out) const -> bool {
+    BasicStringSink<String> sink(out);
+    return fast_format(sink);
+  }
 };
 
 namespace Internal {
@@ -50,6 +127,554 @@ struct ValidateFormatParameters<Arg, Args...> {
 template <>
 struct ValidateFormatParameters<> {};
 
+/// A printf conversion in the subset rendered without snprintf:
+/// flags `-` and `0`, a decimal width, a precision for %f and %s, the length
+/// modifiers l, ll and z, and the conversions d i u x X s f.
+struct PrintfSpec {
+  bool left = false;
+  bool zero = false;
+  size_t width = 0;
+  int precision = -1;
+  /// Size in bytes of the integer the length modifier selects (0 for none).
+  size_t length = 0;
+  char conversion = 0;
+};
+
+/// Parse the conversion following a `%`. Returns the number of characters
+/// consumed, or 0 if the conversion is outside the supported subset.
+constexpr auto ParsePrintfSpec(const char* p, PrintfSpec& spec) -> size_t {
+  const char* start = p;
+  spec = PrintfSpec();
+  for (;; ++p) {
+    if (*p == '-') {
+      spec.left = true;
+    } else if (*p == '0') {
+      spec.zero = true;
+    } else {
+      break;
+    }
+  }
+  while (*p >= '0' && *p <= '9') {
+    spec.width = spec.width * 10 + (*p++ - '0');
+    if (spec.width > 4096) {
+      return 0;
+    }
+  }
+  if (*p == '.') {
+    ++p;
+    spec.precision = 0;
+    while (*p >= '0' && *p <= '9') {
+      spec.precision = spec.precision * 10 + (*p++ - '0');
+      if (spec.precision > 99) {
+        return 0;
+      }
+    }
+  }
+  if (*p == 'l') {
+    ++p;
+    spec.length = sizeof(long);
+    if (*p == 'l') {
+      ++p;
+      spec.length = sizeof(long long);
+    }
+  } else if (*p == 'z') {
+    ++p;
+    spec.length = sizeof(size_t);
+  }
+  switch (*p) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+      if (spec.precision >= 0) {
+        return 0;
+      }
+      break;
+    case 's':
+      if (spec.zero || spec.length != 0) {
+        return 0;
+      }
+      break;
+    case 'f':
+      if (spec.length != 0 && spec.length != sizeof(long)) {
+        return 0;
+      }
+      break;
+    default:
+      return 0;
+  }
+  spec.conversion = *p++;
+  return p - start;
+}
+
+/// Whether \p arg is what snprintf would read for \p spec, so that the fast
+/// path produces identical output.
+template <typename T>
+auto CanFastPrint(const PrintfSpec& spec, const T& arg) -> bool {
+  switch (spec.conversion) {
+    case 'd':
+    case 'i':
+    case 'u':
+    case 'x':
+    case 'X':
+      if constexpr (std::is_integral_v<T>) {
+        size_t size = sizeof(decltype(+arg));
+        return spec.length == 0 ? size == sizeof(int) : size == spec.length;
+      }
+      return false;
+    case 's':
+      if constexpr (std::is_same_v<std::decay_t<T>, const char*> ||
+                    std::is_same_v<std::decay_t<T>, char*>) {
+        return arg != nullptr;
+      }
+      return false;
+    case 'f':
+      if constexpr (std::is_same_v<T, float> || std::is_same_v<T, double>) {
+        return std::isfinite(arg);
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+/// Write \p body, preceded by a minus sign if \p negative, padded to the
+/// spec's width. Zero padding goes between the sign and the digits.
+inline void PrintfPad(FormatSink& os, const PrintfSpec& spec, bool negative,
+                      std::string_view body) {
+  size_t size = (negative ? 1 : 0) + body.size();
+  size_t pad = spec.width > size ? spec.width - size : 0;
+  if (!spec.left && !spec.zero) {
+    os.fill(' ', pad);
+  }
+  if (negative) {
+    os.put('-');
+  }
+  if (!spec.left && spec.zero) {
+    os.fill('0', pad);
+  }
+  os.write(body);
+  if (spec.left) {
+    os.fill(' ', pad);
+  }
+}
+
+template <typename T>
+void FastPrint(FormatSink& os, const PrintfSpec& spec, const T& arg) {
+  if constexpr (std::is_integral_v<T>) {
+    // Apply the default promotions, then reinterpret as snprintf would.
+    using Promoted = decltype(+arg);
+    char buffer[MaxIntegerSize];
+    char* end = buffer + MaxIntegerSize;
+    char* begin;
+    bool negative = false;
+    if (spec.conversion == 'd' || spec.conversion == 'i') {
+      auto value = static_cast<std::make_signed_t<Promoted>>(arg);
+      begin = WriteDecimal(end, IntegerMagnitude(value));
+      negative = value < 0;
+    } else {
+      auto value = static_cast<std::make_unsigned_t<Promoted>>(arg);
+      begin = spec.conversion == 'u'
+                  ? WriteDecimal(end, value)
+                  : WritePowerOfTwo(end, value, 4, spec.conversion == 'X');
+    }
+    PrintfPad(os, spec, negative, std::string_view(begin, end - begin));
+  } else if constexpr (std::is_floating_point_v<T>) {
+    char buffer[MaxFloatSize];
+    auto result = std::to_chars(buffer, buffer + MaxFloatSize,
+                                static_cast<double>(arg),
+                                std::chars_format::fixed,
+                                spec.precision < 0 ? 6 : spec.precision);
+    std::string_view body(buffer, result.ptr - buffer);
+    bool negative = body.front() == '-';
+    if (negative) {
+      body.remove_prefix(1);
+    }
+    PrintfPad(os, spec, negative, body);
+  } else if constexpr (std::is_same_v<std::decay_t<T>, const char*> ||
+                       std::is_same_v<std::decay_t<T>, char*>) {
+    size_t size;
+    if (spec.precision < 0) {
+      size = std::strlen(arg);
+    } else {
+      // Only `precision` bytes may be read; the string can be unterminated.
+      auto precision = static_cast<size_t>(spec.precision);
+      const void* nul = std::memchr(arg, '\0', precision);
+      size = nul != nullptr ? static_cast<const char*>(nul) - arg : precision;
+    }
+    PrintfPad(os, spec, false, std::string_view(arg, size));
+  }
+}
+
+/// Walk \p fmt, writing literal text to \p os (if non-null) and calling
+/// \p f(index, spec) for each conversion. Returns false as soon as a
+/// conversion is outside the fast subset or \p f returns false.
+template <typename F>
+auto VisitPrintfFormat(const char* fmt, FormatSink* os, F&& f) -> bool {
+  size_t index = 0;
+  const char* p = fmt;
+  while (true) {
+    const char* percent = std::strchr(p, '%');
+    if (percent == nullptr) {
+      if (os != nullptr) {
+        os->write(p, std::strlen(p));
+      }
+      return true;
+    }
+    if (os != nullptr) {
+      os->write(p, percent - p);
+    }
+    if (percent[1] == '%') {
+      if (os != nullptr) {
+        os->put('%');
+      }
+      p = percent + 2;
+      continue;
+    }
+    PrintfSpec spec;
+    size_t consumed = ParsePrintfSpec(percent + 1, spec);
+    if (consumed == 0 || !f(index++, spec)) {
+      return false;
+    }
+    p = percent + 1 + consumed;
+  }
+}
+
+/// Errors found when checking a printf format string at compile time.
+enum class PrintfError : uint8_t {
+  None,
+  InvalidConversion,  // Unknown conversion, %n, or a wide %lc / %ls.
+  Unterminated,       // A `%` at the end of the string.
+  TooFewArguments,
+  TooManyArguments,
+  ArgumentType,       // An argument does not match its conversion.
+};
+
+/// The type of value a conversion reads from the argument list.
+enum class PrintfArgKind : uint8_t {
+  None,        // %%
+  Int,         // d i c, and the `*` width and precision
+  Unsigned,    // o u x X
+  Double,      // f F e E g G a A
+  LongDouble,  // the same with the L modifier
+  String,      // s
+  Pointer,     // p
+};
+
+/// One conversion of a printf format string, as found at compile time.
+struct PrintfConversion {
+  /// Literal text before the conversion, as an offset and size into fmt.
+  size_t literal_offset = 0;
+  size_t literal_size = 0;
+  /// The conversion itself, from `%` through the conversion character.
+  size_t offset = 0;
+  size_t size = 0;
+  PrintfArgKind kind = PrintfArgKind::None;
+  /// For Int and Unsigned, the size of the promoted integer that is read.
+  size_t int_size = 0;
+  /// Argument indices; the `*` ones are npos when absent.
+  size_t width_arg = std::string_view::npos;
+  size_t precision_arg = std::string_view::npos;
+  size_t arg = 0;
+  /// Whether the conversion is in the subset FastPrint handles.
+  bool fast = false;
+  PrintfSpec spec;
+};
+
+/// Parse the conversion starting at the `%` at \p pos, assigning argument
+/// indices from \p next_arg. Returns the position after the conversion, or
+/// npos with \p error set.
+constexpr auto ParsePrintfConversion(std::string_view fmt, size_t pos,
+                                     size_t& next_arg, PrintfConversion& c,
+                                     PrintfError& error) -> size_t {
+  auto at = [&](size_t i) { return i < fmt.size() ? fmt[i] : '\0'; };
+  auto is_digit = [](char ch) { return ch >= '0' && ch <= '9'; };
+  size_t p = pos + 1;
+  while (at(p) == '-' || at(p) == '+' || at(p) == ' ' || at(p) == '#' ||
+         at(p) == '0') {
+    ++p;
+  }
+  if (at(p) == '*') {
+    c.width_arg = next_arg++;
+    ++p;
+  }
+  while (is_digit(at(p))) {
+    ++p;
+  }
+  if (at(p) == '.') {
+    ++p;
+    if (at(p) == '*') {
+      c.precision_arg = next_arg++;
+      ++p;
+    }
+    while (is_digit(at(p))) {
+      ++p;
+    }
+  }
+
+  size_t int_size = sizeof(int);
+  bool wide = false;
+  bool long_double = false;
+  switch (at(p)) {
+    case 'h':
+      p += at(p + 1) == 'h' ? 2 : 1;
+      break;
+    case 'l':
+      wide = true;
+      int_size = sizeof(long);
+      if (at(p + 1) == 'l') {
+        int_size = sizeof(long long);
+        ++p;
+      }
+      ++p;
+      break;
+    case 'j':
+      int_size = sizeof(intmax_t);
+      ++p;
+      break;
+    case 'z':
+      int_size = sizeof(size_t);
+      ++p;
+      break;
+    case 't':
+      int_size = sizeof(ptrdiff_t);
+      ++p;
+      break;
+    case 'L':
+      long_double = true;
+      ++p;
+      break;
+    default:
+      break;
+  }
+
+  char conversion = at(p);
+  switch (conversion) {
+    case '\0':
+      error = PrintfError::Unterminated;
+      return std::string_view::npos;
+    case 'd':
+    case 'i':
+      c.kind = PrintfArgKind::Int;
+      break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      c.kind = PrintfArgKind::Unsigned;
+      break;
+    case 'c':
+      c.kind = PrintfArgKind::Int;
+      if (wide) {
+        error = PrintfError::InvalidConversion;
+        return std::string_view::npos;
+      }
+      break;
+    case 'f':
+    case 'F':
+    case 'e':
+    case 'E':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+      c.kind = long_double ? PrintfArgKind::LongDouble : PrintfArgKind::Double;
+      break;
+    case 's':
+      c.kind = PrintfArgKind::String;
+      if (wide) {
+        error = PrintfError::InvalidConversion;
+        return std::string_view::npos;
+      }
+      break;
+    case 'p':
+      c.kind = PrintfArgKind::Pointer;
+      break;
+    case '%':
+      c.kind = PrintfArgKind::None;
+      break;
+    default:
+      error = PrintfError::InvalidConversion;
+      return std::string_view::npos;
+  }
+  if (long_double && c.kind != PrintfArgKind::LongDouble) {
+    error = PrintfError::InvalidConversion;
+    return std::string_view::npos;
+  }
+  ++p;
+
+  c.offset = pos;
+  c.size = p - pos;
+  c.int_size = int_size;
+  if (c.kind != PrintfArgKind::None) {
+    c.arg = next_arg++;
+  }
+  c.fast = c.kind != PrintfArgKind::None &&
+           ParsePrintfSpec(fmt.data() + pos + 1, c.spec) == c.size - 1;
+  return p;
+}
+
+/// Call \p f for every conversion in \p fmt, including `%%`. Returns the
+/// number of arguments the string reads; parsing stops at the first error.
+template <typename F>
+constexpr auto VisitPrintfString(std::string_view fmt, F&& f,
+                                 PrintfError& error) -> size_t {
+  size_t next_arg = 0;
+  size_t pos = 0;
+  while (pos < fmt.size()) {
+    size_t percent = fmt.find('%', pos);
+    if (percent == std::string_view::npos) {
+      break;
+    }
+    PrintfConversion c;
+    c.literal_offset = pos;
+    c.literal_size = percent - pos;
+    pos = ParsePrintfConversion(fmt, percent, next_arg, c, error);
+    if (pos == std::string_view::npos) {
+      break;
+    }
+    f(c);
+  }
+  return next_arg;
+}
+
+constexpr auto CountPrintfConversions(std::string_view fmt) -> size_t {
+  size_t count = 0;
+  PrintfError error = PrintfError::None;
+  VisitPrintfString(
+      fmt, [&](const PrintfConversion& /*unused*/) { ++count; }, error);
+  return count;
+}
+
+/// The parsed form of a printf format string.
+template <size_t N>
+struct PrintfProgram {
+  std::array<PrintfConversion, N> conversions{};
+  /// Literal text after the last conversion.
+  size_t tail_offset = 0;
+  size_t arg_count = 0;
+  /// Whether any conversion takes its width or precision from an argument.
+  bool star = false;
+  PrintfError error = PrintfError::None;
+};
+
+template <size_t N>
+constexpr auto ParsePrintfProgram(std::string_view fmt) -> PrintfProgram<N> {
+  PrintfProgram<N> program;
+  size_t i = 0;
+  program.arg_count = VisitPrintfString(
+      fmt,
+      [&](const PrintfConversion& c) {
+        program.conversions[i++] = c;
+        program.tail_offset = c.offset + c.size;
+        program.star |= c.width_arg != std::string_view::npos ||
+                        c.precision_arg != std::string_view::npos;
+      },
+      program.error);
+  return program;
+}
+
+/// What printf can accept for an argument of a given type.
+struct PrintfArgInfo {
+  bool integral = false;
+  size_t promoted_size = 0;
+  bool floating = false;
+  bool long_double = false;
+  bool string = false;
+  bool pointer = false;
+
+  template <typename T>
+  static constexpr auto Of() -> PrintfArgInfo {
+    PrintfArgInfo info;
+    if constexpr (std::is_integral_v<T>) {
+      info.integral = true;
+      info.promoted_size = sizeof(decltype(+std::declval<T>()));
+    }
+    info.floating = std::is_same_v<T, float> || std::is_same_v<T, double>;
+    info.long_double = std::is_same_v<T, long double>;
+    info.string = std::is_same_v<T, const char*> || std::is_same_v<T, char*>;
+    info.pointer = std::is_pointer_v<T> || std::is_null_pointer_v<T>;
+    return info;
+  }
+};
+
+constexpr auto PrintfArgMatches(PrintfArgKind kind, size_t int_size,
+                                const PrintfArgInfo& info) -> bool {
+  switch (kind) {
+    case PrintfArgKind::Int:
+    case PrintfArgKind::Unsigned:
+      return info.integral && info.promoted_size == int_size;
+    case PrintfArgKind::Double:
+      return info.floating;
+    case PrintfArgKind::LongDouble:
+      return info.long_double;
+    case PrintfArgKind::String:
+      return info.string;
+    case PrintfArgKind::Pointer:
+      return info.pointer;
+    default:
+      return true;
+  }
+}
+
+/// Check the argument count and the type of every argument against \p fmt.
+template <size_t N, size_t M>
+constexpr auto CheckPrintfArgs(const PrintfProgram<N>& program,
+                               const std::array<PrintfArgInfo, M>& args)
+    -> PrintfError {
+  if (program.error != PrintfError::None) {
+    return program.error;
+  }
+  if (program.arg_count > M) {
+    return PrintfError::TooFewArguments;
+  }
+  if (program.arg_count < M) {
+    return PrintfError::TooManyArguments;
+  }
+  for (const auto& c : program.conversions) {
+    for (size_t star : {c.width_arg, c.precision_arg}) {
+      if (star != std::string_view::npos &&
+          !PrintfArgMatches(PrintfArgKind::Int, sizeof(int), args[star])) {
+        return PrintfError::ArgumentType;
+      }
+    }
+    if (c.kind != PrintfArgKind::None &&
+        !PrintfArgMatches(c.kind, c.int_size, args[c.arg])) {
+      return PrintfError::ArgumentType;
+    }
+  }
+  return PrintfError::None;
+}
+
+/// The text of conversion \p c as a NUL-terminated array, for snprintf.
+template <size_t Size>
+constexpr auto PrintfConversionText(std::string_view text)
+    -> std::array<char, Size + 1> {
+  std::array<char, Size + 1> result{};
+  for (size_t i = 0; i < Size; ++i) {
+    result[i] = text[i];
+  }
+  return result;
+}
+
+/// Format a single conversion with snprintf, via the stack when it fits.
+template <typename... Ts>
+void SnprintfConversion(FormatSink& os, const char* text, const Ts&... args) {
+  char stack[FormatObjectBase::StackSize];
+  int n = std::snprintf(stack, sizeof(stack), text, args...);
+  if (n < 0) {
+    return;
+  }
+  if (unsigned(n) < sizeof(stack)) {
+    os.write(stack, n);
+    return;
+  }
+  std::unique_ptr<char[]> heap(new char[n + 1]);
+  std::snprintf(heap.get(), n + 1, text, args...);
+  os.write(heap.get(), n);
+}
+
 }  // namespace Internal
 
 template <typename... Ts>
@@ -65,6 +690,43 @@ class FormatObject final : public FormatObjectBase {
   }
 
  private:
+  auto fast_format(FormatSink& os) const -> bool override {
+    // Check every conversion against its argument before writing anything.
+    size_t conversions = 0;
+    bool supported = Internal::VisitPrintfFormat(
+        fmt_, nullptr, [&](size_t index, const Internal::PrintfSpec& spec) {
+          ++conversions;
+          return VisitArg(index, [&](const auto& arg) {
+            return Internal::CanFastPrint(spec, arg);
+          });
+        });
+    if (!supported || conversions != sizeof...(Ts)) {
+      return false;
+    }
+    Internal::VisitPrintfFormat(
+        fmt_, &os, [&](size_t index, const Internal::PrintfSpec& spec) {
+          return VisitArg(index, [&](const auto& arg) {
+            Internal::FastPrint(os, spec, arg);
+            return true;
+          });
+        });
+    return true;
+  }
+
+  /// Call \p f with the argument at \p index; false if out of range.
+  template <typename F>
+  auto VisitArg(size_t index, F&& f) const -> bool {
+    return std::apply(
+        [&](const auto&... args) {
+          size_t i = 0;
+          bool result = false;
+          static_cast<void>(
+              ((i++ == index ? (result = f(args), true) : false) || ...));
+          return result;
+        },
+        args_);
+  }
+
   template <std::size_t... Is>
   auto snprint_tuple(char* buffer, unsigned buffer_size,
                      std::index_sequence<Is...> /*unused*/) const -> int {
@@ -74,11 +736,103 @@ class FormatObject final : public FormatObjectBase {
   std::tuple<Ts...> args_;
 };
 
+/// A FormatObject whose format string is checked at compile time.
+/// The conversions are parsed into a table once, and formatting runs an
+/// unrolled sequence of per-conversion emitters: FastPrint for the common
+/// subset, and snprintf on just that conversion's text otherwise. Format
+/// strings using `*` widths fall back to a single snprintf call.
+template <typename S, typename... Ts>
+class StaticFormatObject final : public FormatObjectBase {
+  static constexpr std::string_view Fmt = S::data();
+  static constexpr size_t NumConversions =
+      Internal::CountPrintfConversions(Fmt);
+  static constexpr auto Program =
+      Internal::ParsePrintfProgram<NumConversions>(Fmt);
+  static constexpr Internal::PrintfError Error = Internal::CheckPrintfArgs(
+      Program, std::array<Internal::PrintfArgInfo, sizeof...(Ts)>{
+                   Internal::PrintfArgInfo::Of<Ts>()...});
+
+  static_assert(Error != Internal::PrintfError::InvalidConversion,
+                "Invalid or unsupported printf conversion specification!");
+  static_assert(Error != Internal::PrintfError::Unterminated,
+                "Unterminated printf conversion. Escape with %% for a "
+                "literal percent sign.");
+  static_assert(Error != Internal::PrintfError::TooFewArguments,
+                "Too few arguments for the printf format string!");
+  static_assert(Error != Internal::PrintfError::TooManyArguments,
+                "Too many arguments for the printf format string!");
+  static_assert(Error != Internal::PrintfError::ArgumentType,
+                "printf argument type does not match its conversion!");
+
+ public:
+  explicit StaticFormatObject(const Ts&... args)
+      : FormatObjectBase(Fmt.data()), args_(args...) {
+    Internal::ValidateFormatParameters<Ts...>();
+  }
+
+  auto snprint(char* buffer, unsigned buffer_size) const -> int override {
+    return std::apply(
+        [&](const auto&... args) {
+          return std::snprintf(buffer, buffer_size, Fmt.data(), args...);
+        },
+        args_);
+  }
+
+ private:
+  auto fast_format(FormatSink& os) const -> bool override {
+    if constexpr (Program.star) {
+      return false;
+    } else {
+      EmitAll(os, std::make_index_sequence<NumConversions>());
+      os.write(Fmt.substr(Program.tail_offset));
+      return true;
+    }
+  }
+
+  template <size_t... Is>
+  void EmitAll(FormatSink& os, std::index_sequence<Is...> /*unused*/) const {
+    (Emit<Is>(os), ...);
+  }
+
+  template <size_t I>
+  void Emit(FormatSink& os) const {
+    constexpr const Internal::PrintfConversion& c = Program.conversions[I];
+    os.write(Fmt.substr(c.literal_offset, c.literal_size));
+    if constexpr (c.kind == Internal::PrintfArgKind::None) {
+      os.put('%');
+    } else {
+      const auto& arg = std::get<c.arg>(args_);
+      if constexpr (c.fast) {
+        if (Internal::CanFastPrint(c.spec, arg)) {
+          Internal::FastPrint(os, c.spec, arg);
+          return;
+        }
+      }
+      static constexpr auto Text = Internal::PrintfConversionText<c.size>(
+          Fmt.substr(c.offset, c.size));
+      Internal::SnprintfConversion(os, Text.data(), arg);
+    }
+  }
+
+  std::tuple<Ts...> args_;
+};
+
+/// Arguments are stored decayed, so string literals are kept as pointers.
 template <typename... Ts>
-inline auto format(const char* fmt, const Ts&... args) -> FormatObject<Ts...> {
-  return FormatObject<Ts...>(fmt, args...);
+inline auto format(const char* fmt, const Ts&... args)
+    -> FormatObject<std::decay_t<const Ts>...> {
+  return FormatObject<std::decay_t<const Ts>...>(fmt, args...);
+}
+
+/// Compile-time checked version: a mismatched argument count or type, such
+/// as format(FORMATV_STR("%s"), 12.3), is a compile error.
+template <typename S, typename... Ts>
+inline auto format(S /*fmt*/, const Ts&... args)
+    -> std::enable_if_t<std::is_base_of_v<CompileString, S>,
+                        StaticFormatObject<S, std::decay_t<const Ts>...>> {
+  return StaticFormatObject<S, std::decay_t<const Ts>...>(args...);
 }
 
 }  // namespace Formatv
 
-#endif  // FORMATV_FORMAT_H
\ No newline at end of file
+#endif  // FORMATV_FORMAT_H
@@ -1,68 +1,105 @@
 #ifndef FORMATV_FORMAT_ALIGN_H
 #define FORMATV_FORMAT_ALIGN_H
 
-#include <sstream>
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string_view>
 
+#include "FormatArgs.h"
+#include "FormatInstrument.h"
+#include "FormatMemory.h"
+#include "FormatSink.h"
 #include "FormatVariadicDetails.h"
 
 namespace Formatv {
 
-enum class AlignStyle : uint8_t {
-  Left,    // "-"
-  Center,  // "="
-  Right,   // "+"
-};
-
 struct FormatAlign {
-  Internal::FormatAdapter& adapter_; // 引用要格式化并对齐的FormatAdapter。
+  const Internal::FormatArg& arg_; // 引用要格式化并对齐的参数。
   AlignStyle where_; // 一个指示如何对齐输出的AlignStyle枚举值。
   size_t amount_; // 指示总共需要多少字符宽度的大小。
   char fill_; // 当输出的文本不足指定的字符宽度时，用来填充的字符，默认为空格。
 
-  FormatAlign(Internal::FormatAdapter& adapter, AlignStyle where, size_t amount,
+  FormatAlign(const Internal::FormatArg& arg, AlignStyle where, size_t amount,
               char fill = ' ')
-      : adapter_(adapter), where_(where), amount_(amount), fill_(fill) {}
+      : arg_(arg), where_(where), amount_(amount), fill_(fill) {}
+
+  // 对齐后输出的精确长度。
+  auto formatted_size(std::string_view options) -> size_t {
+    return std::max(amount_, arg_.formatted_size(options));
+  }
+
+  // 不格式化就能得知的对齐后长度。
+  auto size_hint(std::string_view options) -> std::optional<size_t> {
+    if (auto size = arg_.size_hint(options)) {
+      return std::max(amount_, *size);
+    }
+    return std::nullopt;
+  }
 
-  void format(std::ostream& os, std::string options) {
+  void format(FormatSink& os, std::string_view options) {
     if (amount_ == 0) {
-      adapter_.format(os, options);
+      arg_.format(os, options);
       return;
     }
 
-    std::ostringstream stream;
-
-    adapter_.format(stream, options);
+    Internal::AlignScope scope;
 
-    std::string item = stream.str();
-    if (amount_ <= item.size()) {
-      os << item;
+    // 能预先得知长度时，先写填充再直接格式化到 os，不需要中间缓冲区。
+    if (auto size = arg_.size_hint(options)) {
+      size_t pad_amount = amount_ > *size ? amount_ - *size : 0;
+      size_t before = Before(pad_amount);
+      os.fill(fill_, before);
+      arg_.format(os, options);
+      os.fill(fill_, pad_amount - before);
       return;
     }
 
-    size_t pad_amount = amount_ - item.size();
-    switch (where_) {
-      case AlignStyle::Left:
-        os << item;
-        fill(os, pad_amount);
-        break;
-      case AlignStyle::Center: {
-        size_t x = pad_amount / 2;
-        fill(os, x);
-        os << item;
-        fill(os, pad_amount - x);
-        break;
+    // 左对齐时填充在后面，写完后根据写入的字节数补齐即可。
+    if (where_ == AlignStyle::Left) {
+      size_t start = os.count();
+      arg_.format(os, options);
+      size_t written = os.count() - start;
+      if (written < amount_) {
+        os.fill(fill_, amount_ - written);
       }
-      default:
-        fill(os, pad_amount);
-        os << item;
-        break;
+      return;
+    }
+
+    // 其余情况先格式化到栈上的缓冲区中测量长度，
+    // 超出时使用线程本地的 ScratchArena，离开作用域即归还。
+    // 超过 BufferLimit 的字段只计数，写完填充后再直接格式化到 os，
+    // 因此无论字段多宽，临时内存都不超过 BufferLimit。
+    scope.Buffered();
+    ScratchScope scratch;
+    ScratchBufferSink<ScratchSize> stream(BufferLimit);
+    arg_.format(stream, options);
+
+    size_t size = stream.count();
+    size_t pad_amount = amount_ > size ? amount_ - size : 0;
+    size_t before = Before(pad_amount);
+    os.fill(fill_, before);
+    if (stream.truncated()) {
+      arg_.format(os, options);
+    } else {
+      os.write(stream.view());
     }
+    os.fill(fill_, pad_amount - before);
   }
 
  private:
-  void fill(std::ostream& os, uint32_t count) {
-    for (uint32_t i = 0; i < count; ++i) {
-      os << fill_;
+  static constexpr size_t ScratchSize = 256;
+  static constexpr size_t BufferLimit = ScratchArena::MaxRetained;
+
+  // 内容之前需要的填充字符数。
+  auto Before(size_t pad_amount) const -> size_t {
+    switch (where_) {
+      case AlignStyle::Left:
+        return 0;
+      case AlignStyle::Center:
+        return pad_amount / 2;
+      default:
+        return pad_amount;
     }
   }
 };
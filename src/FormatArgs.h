@@ -0,0 +1,298 @@
+#ifndef FORMATV_FORMAT_ARGS_H
+#define FORMATV_FORMAT_ARGS_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "FormatProviders.h"
+#include "FormatSink.h"
+#include "FormatUtil.h"
+#include "FormatVariadicDetails.h"
+
+namespace Formatv {
+
+namespace Internal {
+
+template <typename T>
+struct DependentFalse : std::false_type {};
+
+// 类型擦除后的格式化参数。
+// 内置类型（整数、浮点数、字符串、字符、指针）的值直接保存在对象内部，
+// 格式化时通过 switch 分派；其余类型只保存对象的地址和格式化函数的指针，
+// 只有这些类型才需要一次间接调用。
+// 字符串和自定义类型引用原对象，FormatArg 的生命周期不能超过它。
+class FormatArg {
+ public:
+  enum class Type : uint8_t {
+    None,
+    Signed,
+    Unsigned,
+    Float,
+    Double,
+    String,
+    Char,
+    Pointer,
+    Custom,
+  };
+
+  using FormatFn = void (*)(const void* object, FormatSink& os,
+                            std::string_view options);
+  using SizeFn = auto (*)(const void* object, std::string_view options)
+      -> std::optional<size_t>;
+
+  constexpr FormatArg() : uint_value_(0) {}
+
+  template <typename T>
+  static auto Make(const T& value) -> FormatArg;
+
+  auto type() const -> Type { return type_; }
+
+  void format(FormatSink& os, std::string_view options) const {
+    switch (type_) {
+      case Type::Signed:
+        FormatInteger(os, IntegerMagnitude(int_value_), int_value_ < 0, bits_,
+                      options);
+        break;
+      case Type::Unsigned:
+        FormatInteger(os, uint_value_, false, bits_, options);
+        break;
+      case Type::Float:
+        FormatFloat(os, float_value_, options);
+        break;
+      case Type::Double:
+        FormatFloat(os, double_value_, options);
+        break;
+      case Type::String:
+        os.write(TruncateString({string_.data, string_.size}, options));
+        break;
+      case Type::Char:
+        os.put(char_value_);
+        break;
+      case Type::Pointer:
+        FormatInteger(os, reinterpret_cast<uintptr_t>(pointer_), false, bits_,
+                      options.empty() ? "x" : options);
+        break;
+      case Type::Custom:
+        custom_.format(custom_.object, os, options);
+        break;
+      default:
+        break;
+    }
+  }
+
+  // 不实际格式化就能得知的输出长度，无法廉价得知时返回 std::nullopt。
+  auto size_hint(std::string_view options) const -> std::optional<size_t> {
+    switch (type_) {
+      case Type::Signed:
+        return IntegerSize(IntegerMagnitude(int_value_), int_value_ < 0, bits_,
+                           options);
+      case Type::Unsigned:
+        return IntegerSize(uint_value_, false, bits_, options);
+      case Type::String:
+        return TruncateString({string_.data, string_.size}, options).size();
+      case Type::Char:
+        return 1;
+      case Type::Pointer:
+        return IntegerSize(reinterpret_cast<uintptr_t>(pointer_), false, bits_,
+                           options.empty() ? "x" : options);
+      case Type::Custom:
+        return custom_.size(custom_.object, options);
+      case Type::None:
+        return 0;
+      default:
+        return std::nullopt;
+    }
+  }
+
+  // 输出的精确长度，必要时格式化到 CountingSink 中计数。
+  auto formatted_size(std::string_view options) const -> size_t {
+    if (auto size = size_hint(options)) {
+      return *size;
+    }
+    CountingSink sink;
+    format(sink, options);
+    return sink.count();
+  }
+
+ private:
+  struct StringValue {
+    const char* data;
+    size_t size;
+  };
+
+  struct CustomValue {
+    const void* object;
+    FormatFn format;
+    SizeFn size;
+  };
+
+  template <typename T>
+  static void FormatWithProvider(const void* object, FormatSink& os,
+                                 std::string_view options) {
+    using Provider = FormatProvider<std::decay_t<T>>;
+    const T& value = *static_cast<const T*>(object);
+    if constexpr (HasFormatProvider<T>::Value) {
+      Provider::format(value, os, options);
+    } else {
+      // 旧版本的 provider 写入 std::ostream，通过包装了 sink 的临时流调用；
+      // std::string 的选项同样可以传给接受 std::string_view 的签名。
+      SinkStreamBuf buf(os);
+      std::ostream stream(&buf);
+      Provider::format(value, stream, std::string(options));
+    }
+  }
+
+  template <typename T>
+  static auto ProviderSize(const void* object, std::string_view options)
+      -> std::optional<size_t> {
+    if constexpr (HasFormatProviderSize<T>::value) {
+      return FormatProvider<std::decay_t<T>>::formatted_size(
+          *static_cast<const T*>(object), options);
+    } else {
+      return std::nullopt;
+    }
+  }
+
+  // 通过包装了 sink 的临时 ostream 调用 operator<<。
+  template <typename T>
+  static void FormatWithStream(const void* object, FormatSink& os,
+                               std::string_view /*options*/) {
+    SinkStreamBuf buf(os);
+    std::ostream stream(&buf);
+    stream << *static_cast<const T*>(object);
+  }
+
+  // 内置数组不退化为指针，使用 FormatRange.h 中范围的 FormatProvider。
+  template <typename T>
+  static void FormatWithRange(const void* object, FormatSink& os,
+                              std::string_view options) {
+    FormatProvider<T>::format(*static_cast<const T*>(object), os, options);
+  }
+
+  static auto NoSize(const void* /*object*/, std::string_view /*options*/)
+      -> std::optional<size_t> {
+    return std::nullopt;
+  }
+
+  // 继承 FormatAdapter 的对象自己完成格式化。
+  template <typename T>
+  static void FormatWithMember(const void* object, FormatSink& os,
+                               std::string_view options) {
+    const_cast<T*>(static_cast<const T*>(object))->format(os, options);
+  }
+
+  template <typename T>
+  static auto MemberSize(const void* object, std::string_view options)
+      -> std::optional<size_t> {
+    return const_cast<T*>(static_cast<const T*>(object))->size_hint(options);
+  }
+
+  void SetCustom(const void* object, FormatFn format, SizeFn size) {
+    type_ = Type::Custom;
+    custom_ = {object, format, size};
+  }
+
+  union {
+    int64_t int_value_;
+    uint64_t uint_value_;
+    float float_value_;
+    double double_value_;
+    StringValue string_;
+    char char_value_;
+    const void* pointer_;
+    CustomValue custom_;
+  };
+  Type type_ = Type::None;
+  // 整数和指针原类型的位数，用于十六进制/二进制的补码输出。
+  uint8_t bits_ = 0;
+};
+
+template <typename T>
+auto FormatArg::Make(const T& value) -> FormatArg {
+  using Decayed = std::decay_t<const T>;
+  FormatArg arg;
+  if constexpr (UsesFormatMember<T>::value) {
+    arg.SetCustom(&value, &FormatWithMember<T>, &MemberSize<T>);
+  } else if constexpr (IsFormattableInteger<Decayed>::value ||
+                       (std::is_same_v<Decayed, bool> &&
+                        !HasFormatProvider<bool>::Value)) {
+    arg.bits_ = sizeof(Decayed) * 8;
+    if constexpr (std::is_signed_v<Decayed>) {
+      arg.type_ = Type::Signed;
+      arg.int_value_ = value;
+    } else {
+      arg.type_ = Type::Unsigned;
+      arg.uint_value_ = value;
+    }
+  } else if constexpr (std::is_same_v<Decayed, float>) {
+    arg.type_ = Type::Float;
+    arg.float_value_ = value;
+  } else if constexpr (std::is_same_v<Decayed, double>) {
+    arg.type_ = Type::Double;
+    arg.double_value_ = value;
+  } else if constexpr (IsStringLike<Decayed>::value) {
+    const Decayed& str = value;  // 字符数组退化为指针。
+    std::string_view view = ToStringView(str);
+    arg.type_ = Type::String;
+    arg.string_ = {view.data(), view.size()};
+  } else if constexpr (std::is_array_v<T>) {
+    arg.SetCustom(&value, &FormatWithRange<T>, &NoSize);
+  } else if constexpr (std::is_same_v<Decayed, char>) {
+    arg.type_ = Type::Char;
+    arg.char_value_ = value;
+  } else if constexpr (std::is_pointer_v<Decayed> &&
+                       std::is_object_v<std::remove_pointer_t<Decayed>> &&
+                       !HasFormatProvider<Decayed>::Value) {
+    arg.type_ = Type::Pointer;
+    arg.bits_ = sizeof(void*) * 8;
+    arg.pointer_ = static_cast<const void*>(value);
+  } else if constexpr (UsesFormatProvider<T>::value) {
+    arg.SetCustom(&value, &FormatWithProvider<T>, &ProviderSize<T>);
+  } else if constexpr (UsesStreamOperator<T>::value) {
+    arg.SetCustom(&value, &FormatWithStream<T>, &NoSize);
+  } else {
+    static_assert(DependentFalse<T>::value,
+                  "Type has neither a FormatProvider nor an operator<<!");
+  }
+  return arg;
+}
+
+}  // namespace Internal
+
+// make_format_args 的结果：一组类型擦除后的参数。
+// 数值直接保存，字符串和自定义类型只保存地址，
+// 因此它只能在被引用的参数仍然有效时使用。
+template <size_t N>
+class FormatArgStore {
+ public:
+  // 直接在存储中构造每个参数，不经过临时数组的复制。
+  template <typename... Ts>
+  explicit FormatArgStore(std::in_place_t /*unused*/, const Ts&... vals)
+      : args_{{Internal::FormatArg::Make(vals)...}} {}
+
+  auto data() const -> const Internal::FormatArg* { return args_.data(); }
+  auto size() const -> size_t { return N; }
+
+  operator ArrayRef<Internal::FormatArg>() const { return args_; }
+
+ private:
+  std::array<Internal::FormatArg, N> args_;
+};
+
+// 按引用捕获参数，构造代价只是每个参数一次 FormatArg 的填充：
+//   vformat_to(sink, "{0} = {1}", make_format_args(name, value));
+template <typename... Ts>
+inline auto make_format_args(const Ts&... vals)
+    -> FormatArgStore<sizeof...(Ts)> {
+  return FormatArgStore<sizeof...(Ts)>(std::in_place, vals...);
+}
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_ARGS_H
@@ -0,0 +1,314 @@
+#ifndef FORMATV_FORMAT_BATCH_H
+#define FORMATV_FORMAT_BATCH_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "FormatAlign.h"
+#include "FormatArgs.h"
+#include "FormatSink.h"
+#include "FormatTemplate.h"
+#include "FormatUtil.h"
+
+namespace Formatv {
+
+// 批量格式化的选项。
+struct BatchOptions {
+  // 先遍历一遍所有行，以每个参数索引的最大输出宽度作为该列的对齐宽度。
+  bool auto_width = false;
+  // 每个参数索引的最小宽度，与模板中的对齐宽度和自动宽度取最大值。
+  ArrayRef<size_t> widths;
+};
+
+namespace Internal {
+
+// 按列宽格式化一行。widths 为空时与 FormatTemplate::format 相同。
+inline void FormatBatchRow(FormatSink& os, ArrayRef<ReplacementItem> items,
+                           ArrayRef<FormatArg> args, ArrayRef<size_t> widths) {
+  for (const auto& r : items) {
+    if (r.type != ReplacementType::Format || r.index >= args.size() ||
+        r.index >= widths.size()) {
+      FormatvObjectBase::FormatItem(os, r, args);
+      continue;
+    }
+    FormatAlign align(args[r.index], r.where,
+                      std::max(r.align, widths[r.index]), r.pad);
+    align.format(os, r.options);
+  }
+}
+
+// 将一行的输出宽度合并到 widths 中。
+inline void MeasureBatchRow(ArrayRef<ReplacementItem> items,
+                            ArrayRef<FormatArg> args,
+                            std::vector<size_t>& widths) {
+  for (const auto& r : items) {
+    if (r.type == ReplacementType::Format && r.index < args.size()) {
+      widths[r.index] =
+          std::max(widths[r.index], args[r.index].formatted_size(r.options));
+    }
+  }
+}
+
+// 以 project(row) 返回的元组中的值作为参数调用 f(ArrayRef<FormatArg>)。
+// 元组可以包含引用（std::forward_as_tuple）或临时计算出的值。
+template <typename Row, typename Projection, typename F>
+void WithRowArgs(const Row& row, Projection& project, F&& f) {
+  std::apply(
+      [&](const auto&... vals) {
+        auto args = make_format_args(vals...);
+        f(ArrayRef<FormatArg>(args));
+      },
+      project(row));
+}
+
+}  // namespace Internal
+
+// 计算每个参数索引在所有行中的最大输出宽度（不含对齐填充）。
+template <typename Range, typename Projection>
+auto column_widths(const FormatTemplate& tmpl, const Range& rows,
+                   Projection project) -> std::vector<size_t> {
+  std::vector<size_t> widths(tmpl.arg_count(), 0);
+  for (const auto& row : rows) {
+    Internal::WithRowArgs(
+        row, project, [&](ArrayRef<Internal::FormatArg> args) {
+          Internal::MeasureBatchRow(tmpl.items(), args, widths);
+        });
+  }
+  return widths;
+}
+
+// 用同一个模板格式化 rows 中的每一行，全部写入 os。
+// project 把一行映射为参数元组，例如：
+//   format_batch(sink, tmpl, records, [](const Record& r) {
+//     return std::forward_as_tuple(r.name, r.count, r.ratio);
+//   });
+// 模板只解析一次，每行的代价只有参数表的填充和实际的格式化。
+template <typename Range, typename Projection>
+void format_batch(FormatSink& os, const FormatTemplate& tmpl,
+                  const Range& rows, Projection project,
+                  const BatchOptions& options = {}) {
+  std::vector<size_t> widths(options.widths.begin(), options.widths.end());
+  if (options.auto_width) {
+    std::vector<size_t> measured = column_widths(tmpl, rows, project);
+    widths.resize(std::max(widths.size(), measured.size()), 0);
+    for (size_t i = 0; i < measured.size(); ++i) {
+      widths[i] = std::max(widths[i], measured[i]);
+    }
+  }
+
+  for (const auto& row : rows) {
+    Internal::WithRowArgs(
+        row, project, [&](ArrayRef<Internal::FormatArg> args) {
+          Internal::FormatBatchRow(os, tmpl.items(), args, widths);
+        });
+  }
+}
+
+// 将所有行格式化到一个连续的字符串中。
+// 先格式化第一行，按其长度为其余行预留空间，之后只在估计不足时增长。
+template <typename Range, typename Projection>
+auto format_batch_str(const FormatTemplate& tmpl, const Range& rows,
+                      Projection project, const BatchOptions& options = {})
+    -> std::string {
+  std::string result;
+  auto count = static_cast<size_t>(std::distance(std::begin(rows),
+                                                 std::end(rows)));
+  if (count > 0) {
+    CountingSink first;
+    Internal::WithRowArgs(*std::begin(rows), project,
+                          [&](ArrayRef<Internal::FormatArg> args) {
+                            tmpl.format(first, args);
+                          });
+    result.reserve(first.count() * count + first.count() / 2);
+  }
+  {
+    StringSink sink(result);
+    format_batch(sink, tmpl, rows, project, options);
+  }
+  return result;
+}
+
+// 列式数据的批量格式化：第 i 行的参数为每一列的第 i 个元素。
+// 行数取各列长度的最小值。
+template <typename... Columns>
+void format_columns(FormatSink& os, const FormatTemplate& tmpl,
+                    const BatchOptions& options, const Columns&... columns) {
+  size_t count = std::min({static_cast<size_t>(std::size(columns))...});
+  struct Indices {
+    size_t count;
+    struct Iterator {
+      size_t i;
+      auto operator*() const -> size_t { return i; }
+      auto operator++() -> Iterator& {
+        ++i;
+        return *this;
+      }
+      auto operator!=(const Iterator& rhs) const -> bool { return i != rhs.i; }
+    };
+    auto begin() const -> Iterator { return {0}; }
+    auto end() const -> Iterator { return {count}; }
+  };
+  format_batch(os, tmpl, Indices{count},
+               [&](size_t i) { return std::forward_as_tuple(columns[i]...); },
+               options);
+}
+
+// 并行批量格式化的选项。
+struct ParallelOptions {
+  // 工作线程数，0 表示 std::thread::hardware_concurrency()。
+  size_t threads = 0;
+  // 每个任务格式化的行数。
+  size_t chunk_rows = 4096;
+  // 同时存在的块缓冲区个数（按线程数的倍数计），限制内存占用。
+  size_t chunks_per_thread = 2;
+};
+
+// 把 rows 分成若干块，由多个线程分别格式化到各自的缓冲区，
+// 再由调用线程按原来的顺序写入 os，输出与 format_batch 完全相同。
+// rows 必须支持随机访问；project 会被多个线程同时调用，必须是线程安全的。
+// 块缓冲区循环使用，内存占用只与线程数和块大小有关，与总行数无关。
+template <typename Range, typename Projection>
+void format_batch_parallel(FormatSink& os, const FormatTemplate& tmpl,
+                           const Range& rows, Projection project,
+                           const ParallelOptions& parallel = {},
+                           const BatchOptions& options = {}) {
+  auto first = std::begin(rows);
+  auto count = static_cast<size_t>(std::distance(first, std::end(rows)));
+  size_t chunk_rows = std::max<size_t>(parallel.chunk_rows, 1);
+  size_t num_chunks = (count + chunk_rows - 1) / chunk_rows;
+  size_t threads = parallel.threads != 0
+                       ? parallel.threads
+                       : std::max(1U, std::thread::hardware_concurrency());
+  threads = std::min(threads, num_chunks);
+  if (threads <= 1) {
+    format_batch(os, tmpl, rows, project, options);
+    return;
+  }
+
+  // 遍历块 k 中的每一行。
+  auto for_each_row = [&](size_t k, auto&& f) {
+    size_t begin = k * chunk_rows;
+    size_t end = std::min(count, begin + chunk_rows);
+    for (size_t i = begin; i < end; ++i) {
+      Internal::WithRowArgs(first[i], project, f);
+    }
+  };
+
+  std::vector<size_t> widths(options.widths.begin(), options.widths.end());
+  if (options.auto_width) {
+    // 每个线程在自己的宽度表上统计，最后合并。
+    std::atomic<size_t> next{0};
+    std::mutex mutex;
+    widths.resize(std::max(widths.size(), tmpl.arg_count()), 0);
+    auto measure_chunks = [&] {
+      std::vector<size_t> local(tmpl.arg_count(), 0);
+      for (size_t k; (k = next.fetch_add(1)) < num_chunks;) {
+        for_each_row(k, [&](ArrayRef<Internal::FormatArg> args) {
+          Internal::MeasureBatchRow(tmpl.items(), args, local);
+        });
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      for (size_t i = 0; i < local.size(); ++i) {
+        widths[i] = std::max(widths[i], local[i]);
+      }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t) {
+      workers.emplace_back(measure_chunks);
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  struct Slot {
+    std::string buffer;
+    size_t chunk = 0;
+    bool ready = false;
+  };
+  size_t window = threads * std::max<size_t>(parallel.chunks_per_thread, 1);
+  std::vector<Slot> slots(window);
+  std::mutex mutex;
+  std::condition_variable cv;
+  size_t next = 0;
+  size_t written = 0;
+
+  auto format_chunks = [&] {
+    while (true) {
+      size_t k;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        // 块 k 的缓冲区在块 k - window 写出之后才能复用。
+        cv.wait(lock, [&] {
+          return next >= num_chunks || next < written + window;
+        });
+        if (next >= num_chunks) {
+          return;
+        }
+        k = next++;
+      }
+
+      Slot& slot = slots[k % window];
+      slot.buffer.clear();
+      {
+        StringSink sink(slot.buffer);
+        for_each_row(k, [&](ArrayRef<Internal::FormatArg> args) {
+          Internal::FormatBatchRow(sink, tmpl.items(), args, widths);
+        });
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      slot.chunk = k;
+      slot.ready = true;
+      cv.notify_all();
+    }
+  };
+  std::vector<std::thread> workers;
+  workers.reserve(threads);
+  for (size_t t = 0; t < threads; ++t) {
+    workers.emplace_back(format_chunks);
+  }
+
+  // 调用线程按顺序写出已完成的块。
+  for (size_t k = 0; k < num_chunks; ++k) {
+    Slot& slot = slots[k % window];
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      cv.wait(lock, [&] { return slot.ready && slot.chunk == k; });
+    }
+    os.write(slot.buffer);
+    std::lock_guard<std::mutex> lock(mutex);
+    slot.ready = false;
+    ++written;
+    cv.notify_all();
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+template <typename Range, typename Projection>
+auto format_batch_parallel_str(const FormatTemplate& tmpl, const Range& rows,
+                               Projection project,
+                               const ParallelOptions& parallel = {},
+                               const BatchOptions& options = {})
+    -> std::string {
+  std::string result;
+  {
+    StringSink sink(result);
+    format_batch_parallel(sink, tmpl, rows, project, parallel, options);
+  }
+  return result;
+}
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_BATCH_H
@@ -0,0 +1,535 @@
+#ifndef FORMATV_FORMAT_BINARY_LOG_H
+#define FORMATV_FORMAT_BINARY_LOG_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "FormatArgs.h"
+#include "FormatProviders.h"
+#include "FormatSink.h"
+#include "FormatTemplate.h"
+#include "FormatVariadicDetails.h"
+
+namespace Formatv {
+
+// 二进制日志：生产环境只记录格式字符串的编号和参数的原始字节，
+// 文本在离线时由 BinaryLogReader（或 formatv_decode 工具）重新生成。
+//
+// 流的格式（整数均为 LEB128 变长编码）：
+//   "FMTVLOG1"                                        文件头
+//   'F' id len bytes[len]                             格式字符串定义
+//   'M' id argc { type payload }[argc]                一条日志
+// 格式字符串在第一次使用时写入定义，因此流是自包含的。
+// 参数的 type 字节高 4 位为 BinaryArgKind，低 4 位为原类型的字节数，
+// 解码时据此还原出相同位宽的整数，保证十六进制等输出与直接格式化一致。
+enum class BinaryArgKind : uint8_t {
+  Signed = 1,    // zigzag 编码的整数
+  Unsigned = 2,  // 无符号整数
+  Float = 3,     // 4 字节 IEEE 754
+  Double = 4,    // 8 字节 IEEE 754
+  String = 5,    // 长度 + 字节
+  Char = 6,      // 1 字节
+  Pointer = 7,   // 按无符号整数编码，解码后以十六进制输出
+  Rendered = 8,  // 个数 + 若干 (选项, 文本)，记录时已按字段的选项格式化
+};
+
+// 自定义类型的编码钩子。默认在记录时按引用该参数的每个字段的选项
+// 分别格式化为文本（Rendered），解码时按字段的选项取回对应的文本，
+// 结果与直接格式化相同；需要更紧凑的记录时可以特化此模板，
+// 转换为一个内置类型的值：
+//   template <> struct BinaryLogCodec<UserId> {
+//     static auto Encode(const UserId& id) -> uint64_t { return id.value; }
+//   };
+template <typename T, typename Enable = void>
+struct BinaryLogCodec {};
+
+namespace Internal {
+
+template <typename T, typename Enable = void>
+struct HasBinaryLogCodec : std::false_type {};
+
+template <typename T>
+struct HasBinaryLogCodec<T, std::void_t<decltype(BinaryLogCodec<T>::Encode(
+                                std::declval<const T&>()))>>
+    : std::true_type {};
+
+inline void WriteVarint(FormatSink& os, uint64_t value) {
+  while (value >= 0x80) {
+    os.put(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  os.put(static_cast<char>(value));
+}
+
+inline auto ZigZag(int64_t value) -> uint64_t {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+inline auto UnZigZag(uint64_t value) -> int64_t {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+inline auto BinaryArgType(BinaryArgKind kind, size_t bytes) -> char {
+  return static_cast<char>((static_cast<uint8_t>(kind) << 4) | bytes);
+}
+
+// 从 data 开头读取一个变长整数。
+inline auto ReadVarint(std::string_view& data, uint64_t& value) -> bool {
+  value = 0;
+  for (int shift = 0; shift < 64 && !data.empty(); shift += 7) {
+    auto byte = static_cast<uint8_t>(data.front());
+    data.remove_prefix(1);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 从 data 开头读取一个带长度前缀的字节串。
+inline auto ReadLengthPrefixed(std::string_view& data, std::string_view& bytes)
+    -> bool {
+  uint64_t size;
+  if (!ReadVarint(data, size) || size > data.size()) {
+    return false;
+  }
+  bytes = data.substr(0, size);
+  data.remove_prefix(size);
+  return true;
+}
+
+// 解码出的 Rendered 参数，payload 是已经校验过的 (选项, 文本) 列表。
+struct BinaryLogRendered {
+  std::string_view payload;
+};
+
+}  // namespace Internal
+
+// 输出与字段选项相同的那一份文本。
+template <>
+struct FormatProvider<Internal::BinaryLogRendered> {
+  static void format(const Internal::BinaryLogRendered& value, FormatSink& os,
+                     std::string_view options) {
+    std::string_view payload = value.payload;
+    uint64_t count;
+    Internal::ReadVarint(payload, count);
+    for (uint64_t i = 0; i < count; ++i) {
+      std::string_view field_options;
+      std::string_view text;
+      if (!Internal::ReadLengthPrefixed(payload, field_options) ||
+          !Internal::ReadLengthPrefixed(payload, text)) {
+        return;
+      }
+      if (field_options == options) {
+        os.write(text);
+        return;
+      }
+    }
+  }
+};
+
+// 把日志编码为二进制流写入 sink。同一个对象不能被多个线程同时使用。
+class BinaryLogWriter {
+ public:
+  static constexpr std::string_view Magic = "FMTVLOG1";
+
+  explicit BinaryLogWriter(FormatSink& out) : out_(out) { out_.write(Magic); }
+
+  BinaryLogWriter(const BinaryLogWriter&) = delete;
+  auto operator=(const BinaryLogWriter&) -> BinaryLogWriter& = delete;
+
+  // fmt 以地址区分，应为字符串字面量；不同地址的相同内容会得到不同的编号。
+  // fmt 在第一次使用时检查，无法解析时触发断言，与运行期的 formatv 相同；
+  // 关闭断言时照常记录，由 BinaryLogReader 报告并跳过。
+  template <typename... Ts>
+  void log(const char* fmt, const Ts&... vals) {
+    uint32_t id = Define(fmt);
+    out_.put('M');
+    Internal::WriteVarint(out_, id);
+    Internal::WriteVarint(out_, sizeof...(Ts));
+    size_t index = 0;
+    (WriteArg(vals, index++, field_options_[id]), ...);
+  }
+
+  // 已定义的格式字符串，按编号排列。
+  auto formats() const -> const std::vector<const char*>& { return formats_; }
+
+ private:
+  // 每个参数被字段引用时使用的各不相同的选项，按参数索引排列。
+  using FieldOptions = std::vector<std::vector<std::string_view>>;
+
+  auto Define(const char* fmt) -> uint32_t {
+    auto it = ids_.find(fmt);
+    if (it != ids_.end()) {
+      return it->second;
+    }
+    auto id = static_cast<uint32_t>(formats_.size());
+    ids_.emplace(fmt, id);
+    formats_.push_back(fmt);
+    std::string_view str(fmt);
+
+    FieldOptions& fields = field_options_.emplace_back();
+    FormatError error = FormatError::None;
+    FormatvObjectBase::VisitFormatString(
+        str,
+        [&](const ReplacementItem& item) {
+          if (item.type != ReplacementType::Format) {
+            return;
+          }
+          if (item.index >= fields.size()) {
+            fields.resize(item.index + 1);
+          }
+          auto& options = fields[item.index];
+          if (std::find(options.begin(), options.end(), item.options) ==
+              options.end()) {
+            options.push_back(item.options);
+          }
+        },
+        &error);
+    assert(error == FormatError::None && "Invalid format string!");
+
+    out_.put('F');
+    Internal::WriteVarint(out_, id);
+    Internal::WriteVarint(out_, str.size());
+    out_.write(str);
+    return id;
+  }
+
+  void WriteRaw(BinaryArgKind kind, const void* data, size_t size) {
+    out_.put(Internal::BinaryArgType(kind, size));
+    out_.write(static_cast<const char*>(data), size);
+  }
+
+  void WriteString(std::string_view str) {
+    out_.put(Internal::BinaryArgType(BinaryArgKind::String, 0));
+    Internal::WriteVarint(out_, str.size());
+    out_.write(str);
+  }
+
+  template <typename T>
+  void WriteArg(const T& value, size_t index, const FieldOptions& fields) {
+    using Decayed = std::decay_t<const T>;
+    if constexpr (Internal::HasBinaryLogCodec<Decayed>::value) {
+      WriteArg(BinaryLogCodec<Decayed>::Encode(value), index, fields);
+    } else if constexpr (Internal::IsFormattableInteger<Decayed>::value ||
+                         (std::is_same_v<Decayed, bool> &&
+                          !Internal::HasFormatProvider<bool>::Value)) {
+      if constexpr (std::is_signed_v<Decayed>) {
+        out_.put(Internal::BinaryArgType(BinaryArgKind::Signed,
+                                         sizeof(Decayed)));
+        Internal::WriteVarint(out_, Internal::ZigZag(value));
+      } else {
+        out_.put(Internal::BinaryArgType(BinaryArgKind::Unsigned,
+                                         sizeof(Decayed)));
+        Internal::WriteVarint(out_, value);
+      }
+    } else if constexpr (std::is_same_v<Decayed, float>) {
+      WriteRaw(BinaryArgKind::Float, &value, sizeof(value));
+    } else if constexpr (std::is_same_v<Decayed, double>) {
+      WriteRaw(BinaryArgKind::Double, &value, sizeof(value));
+    } else if constexpr (Internal::IsStringLike<Decayed>::value) {
+      const Decayed& str = value;
+      WriteString(Internal::ToStringView(str));
+    } else if constexpr (std::is_same_v<Decayed, char>) {
+      WriteRaw(BinaryArgKind::Char, &value, 1);
+    } else if constexpr (std::is_pointer_v<Decayed> && !std::is_array_v<T> &&
+                         std::is_object_v<std::remove_pointer_t<Decayed>> &&
+                         !Internal::HasFormatProvider<Decayed>::Value) {
+      out_.put(Internal::BinaryArgType(BinaryArgKind::Pointer,
+                                       sizeof(Decayed)));
+      Internal::WriteVarint(out_, reinterpret_cast<uintptr_t>(value));
+    } else {
+      // 其余类型（自定义的 FormatProvider、范围等）的选项只有它们自己能解释，
+      // 在记录时按每个引用它的字段的选项分别格式化。
+      out_.put(Internal::BinaryArgType(BinaryArgKind::Rendered, 0));
+      if (index >= fields.size()) {
+        Internal::WriteVarint(out_, 0);
+        return;
+      }
+      Internal::FormatArg arg = Internal::FormatArg::Make(value);
+      Internal::WriteVarint(out_, fields[index].size());
+      for (std::string_view options : fields[index]) {
+        Internal::WriteVarint(out_, options.size());
+        out_.write(options);
+        scratch_.clear();
+        {
+          StringSink sink(scratch_);
+          arg.format(sink, options);
+        }
+        Internal::WriteVarint(out_, scratch_.size());
+        out_.write(scratch_);
+      }
+    }
+  }
+
+  FormatSink& out_;
+  std::unordered_map<const char*, uint32_t> ids_;
+  std::vector<const char*> formats_;
+  std::vector<FieldOptions> field_options_;
+  std::string scratch_;
+};
+
+// 解码 BinaryLogWriter 生成的流，通过 formatv 的模板重新格式化。
+//   BinaryLogReader reader(data);
+//   while (reader.Next(sink)) sink.put('\n');
+//   if (reader.failed()) ...
+// 格式字符串无法解析的日志不会中止解码：这样的一条日志输出为
+// "<invalid format #id>"，并计入 skipped()。
+class BinaryLogReader {
+ public:
+  explicit BinaryLogReader(std::string_view data) : data_(data) {
+    if (data_.substr(0, BinaryLogWriter::Magic.size()) !=
+        BinaryLogWriter::Magic) {
+      Fail("missing FMTVLOG1 header");
+      return;
+    }
+    pos_ = BinaryLogWriter::Magic.size();
+  }
+
+  // 解码下一条日志并写入 os。流结束或出错时返回 false。
+  auto Next(FormatSink& os) -> bool {
+    while (!failed() && pos_ < data_.size()) {
+      char tag = data_[pos_++];
+      if (tag == 'F') {
+        ReadDefinition();
+      } else if (tag == 'M') {
+        return ReadMessage(os);
+      } else {
+        Fail("unknown record tag");
+      }
+    }
+    return false;
+  }
+
+  auto failed() const -> bool { return error_ != nullptr; }
+  // 因格式字符串无法解析而跳过的日志条数。
+  auto skipped() const -> size_t { return skipped_; }
+  auto error() const -> const char* { return error_; }
+  // 出错位置（字节偏移）。
+  auto offset() const -> size_t { return pos_; }
+
+ private:
+  // 解码出的参数值，字符串指向输入数据。
+  struct Value {
+    BinaryArgKind kind;
+    size_t bytes;
+    uint64_t bits;
+    std::string_view str;
+  };
+
+  void Fail(const char* error) {
+    if (error_ == nullptr) {
+      error_ = error;
+    }
+  }
+
+  auto ReadVarint() -> uint64_t {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos_ >= data_.size()) {
+        Fail("truncated varint");
+        return 0;
+      }
+      auto byte = static_cast<uint8_t>(data_[pos_++]);
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if ((byte & 0x80) == 0) {
+        return value;
+      }
+    }
+    Fail("varint too long");
+    return 0;
+  }
+
+  auto ReadBytes(size_t size) -> std::string_view {
+    if (size > data_.size() - pos_) {
+      Fail("truncated record");
+      return {};
+    }
+    std::string_view bytes = data_.substr(pos_, size);
+    pos_ += size;
+    return bytes;
+  }
+
+  void ReadDefinition() {
+    uint64_t id = ReadVarint();
+    std::string_view fmt = ReadBytes(ReadVarint());
+    if (failed()) {
+      return;
+    }
+    if (id != templates_.size()) {
+      Fail("format ids out of order");
+      return;
+    }
+    // FormatTemplate 遇到无法解析的格式字符串会触发断言，先行检查，
+    // 这样的格式保留为空，使用它的日志被跳过。
+    if (FormatvObjectBase::ValidateFormatString(fmt, SIZE_MAX) !=
+        FormatError::None) {
+      templates_.push_back(nullptr);
+      return;
+    }
+    templates_.push_back(std::make_unique<FormatTemplate>(fmt));
+  }
+
+  auto ReadValue() -> Value {
+    Value value{};
+    std::string_view type = ReadBytes(1);
+    if (failed()) {
+      return value;
+    }
+    auto byte = static_cast<uint8_t>(type[0]);
+    value.kind = static_cast<BinaryArgKind>(byte >> 4);
+    value.bytes = byte & 0x0F;
+    switch (value.kind) {
+      case BinaryArgKind::Signed:
+      case BinaryArgKind::Unsigned:
+      case BinaryArgKind::Pointer:
+        value.bits = ReadVarint();
+        break;
+      case BinaryArgKind::Float:
+      case BinaryArgKind::Double:
+      case BinaryArgKind::Char:
+        value.str = ReadBytes(value.bytes);
+        break;
+      case BinaryArgKind::String:
+        value.str = ReadBytes(ReadVarint());
+        break;
+      case BinaryArgKind::Rendered: {
+        // 检查每一对的长度，str 覆盖整个列表，交给 BinaryLogRendered 解析。
+        size_t start = pos_;
+        uint64_t count = ReadVarint();
+        if (count > data_.size() - pos_) {
+          Fail("truncated argument");
+        }
+        for (uint64_t i = 0; i < count * 2 && !failed(); ++i) {
+          ReadBytes(ReadVarint());
+        }
+        value.str = data_.substr(start, pos_ - start);
+        break;
+      }
+      default:
+        Fail("unknown argument type");
+        break;
+    }
+    return value;
+  }
+
+  // 按原类型的位宽还原整数参数。
+  template <typename Signed, typename Unsigned>
+  static auto MakeInteger(const Value& value) -> Internal::FormatArg {
+    if (value.kind == BinaryArgKind::Signed) {
+      return Internal::FormatArg::Make(
+          static_cast<Signed>(Internal::UnZigZag(value.bits)));
+    }
+    return Internal::FormatArg::Make(static_cast<Unsigned>(value.bits));
+  }
+
+  auto MakeArg(const Value& value) -> Internal::FormatArg {
+    switch (value.kind) {
+      case BinaryArgKind::Signed:
+      case BinaryArgKind::Unsigned:
+        switch (value.bytes) {
+          case 1:
+            return MakeInteger<int8_t, uint8_t>(value);
+          case 2:
+            return MakeInteger<int16_t, uint16_t>(value);
+          case 4:
+            return MakeInteger<int32_t, uint32_t>(value);
+          default:
+            return MakeInteger<int64_t, uint64_t>(value);
+        }
+      case BinaryArgKind::Pointer:
+        // 只用于按指针的格式输出地址，不会被解引用。
+        return Internal::FormatArg::Make(reinterpret_cast<const unsigned char*>(
+            static_cast<uintptr_t>(value.bits)));
+      case BinaryArgKind::Float: {
+        float f;
+        std::memcpy(&f, value.str.data(), sizeof(f));
+        return Internal::FormatArg::Make(f);
+      }
+      case BinaryArgKind::Double: {
+        double d;
+        std::memcpy(&d, value.str.data(), sizeof(d));
+        return Internal::FormatArg::Make(d);
+      }
+      case BinaryArgKind::Char:
+        return Internal::FormatArg::Make(value.str[0]);
+      case BinaryArgKind::Rendered:
+        rendered_.push_back({value.str});
+        return Internal::FormatArg::Make(rendered_.back());
+      default:
+        return Internal::FormatArg::Make(value.str);
+    }
+  }
+
+  auto ReadMessage(FormatSink& os) -> bool {
+    uint64_t id = ReadVarint();
+    uint64_t argc = ReadVarint();
+    if (failed()) {
+      return false;
+    }
+    if (id >= templates_.size()) {
+      Fail("message refers to an undefined format");
+      return false;
+    }
+    args_.clear();
+    rendered_.clear();
+    for (uint64_t i = 0; i < argc && !failed(); ++i) {
+      Value value = ReadValue();
+      if (!failed() && value.str.size() < NeededBytes(value)) {
+        Fail("truncated argument");
+      }
+      if (!failed()) {
+        args_.push_back(MakeArg(value));
+      }
+    }
+    if (failed()) {
+      return false;
+    }
+    if (templates_[id] == nullptr) {
+      ++skipped_;
+      os.write("<invalid format #");
+      FormatProvider<uint64_t>::format(id, os, "");
+      os.put('>');
+      return true;
+    }
+    templates_[id]->format(os, args_);
+    return true;
+  }
+
+  static auto NeededBytes(const Value& value) -> size_t {
+    switch (value.kind) {
+      case BinaryArgKind::Float:
+        return sizeof(float);
+      case BinaryArgKind::Double:
+        return sizeof(double);
+      case BinaryArgKind::Char:
+        return 1;
+      default:
+        return 0;
+    }
+  }
+
+  std::string_view data_;
+  size_t pos_ = 0;
+  const char* error_ = nullptr;
+  std::vector<std::unique_ptr<FormatTemplate>> templates_;
+  std::vector<Internal::FormatArg> args_;
+  // 当前日志的 Rendered 参数，args_ 引用其中的元素，追加时地址不变。
+  std::deque<Internal::BinaryLogRendered> rendered_;
+  size_t skipped_ = 0;
+};
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_BINARY_LOG_H
@@ -0,0 +1,475 @@
+#ifndef FORMATV_FORMAT_INSTRUMENT_H
+#define FORMATV_FORMAT_INSTRUMENT_H
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// 编译期开关：定义 FORMATV_INSTRUMENT=1 后，按格式字符串统计 format、
+// ParseFormatString 和 FormatAlign::format 的调用次数、耗时、输出字节数和
+// 库内部的内存分配。默认关闭，此时所有插桩点都是空操作，不产生任何开销。
+// 开关改变的是内联函数的实现，同一程序的所有翻译单元必须使用相同的设置。
+#ifndef FORMATV_INSTRUMENT
+#define FORMATV_INSTRUMENT 0
+#endif
+
+namespace Formatv {
+
+// 一个格式字符串的累计数据，由 InstrumentRegistry::Snapshot() 返回。
+// 耗时包含嵌套的部分：format_ns 中包含了各字段的 align_ns。
+struct InstrumentSite {
+  std::string fmt;
+  size_t format_calls = 0;
+  uint64_t format_ns = 0;
+  // 输出的字节数。
+  size_t bytes = 0;
+  // 库内部的内存分配（输出字符串扩容、ScratchArena 新块、SmallString
+  // 转移到堆上、解析结果），不包括参数的 operator<< 等用户代码中的分配。
+  size_t allocations = 0;
+  size_t allocated_bytes = 0;
+  // 运行期解析的次数和耗时，使用格式字符串缓存时只在未命中时发生。
+  size_t parse_calls = 0;
+  uint64_t parse_ns = 0;
+  // 带宽度的字段经过 FormatAlign 的次数和耗时。
+  size_t align_calls = 0;
+  uint64_t align_ns = 0;
+  // 其中需要先格式化到临时缓冲区再计算填充的次数。
+  size_t align_buffered = 0;
+};
+
+namespace Internal {
+
+// 一个格式字符串的计数器，所有线程共享，只做 relaxed 的原子加法。
+struct InstrumentCounters {
+  using Counter = std::atomic<uint64_t>;
+
+  explicit InstrumentCounters(std::string text) : fmt(std::move(text)) {}
+
+  void Add(Counter& counter, uint64_t value) {
+    counter.fetch_add(value, std::memory_order_relaxed);
+  }
+
+  auto Load() const -> InstrumentSite {
+    auto get = [](const Counter& c) {
+      return c.load(std::memory_order_relaxed);
+    };
+    InstrumentSite site;
+    site.fmt = fmt;
+    site.format_calls = get(format_calls);
+    site.format_ns = get(format_ns);
+    site.bytes = get(bytes);
+    site.allocations = get(allocations);
+    site.allocated_bytes = get(allocated_bytes);
+    site.parse_calls = get(parse_calls);
+    site.parse_ns = get(parse_ns);
+    site.align_calls = get(align_calls);
+    site.align_ns = get(align_ns);
+    site.align_buffered = get(align_buffered);
+    return site;
+  }
+
+  void Reset() {
+    for (Counter* c : {&format_calls, &format_ns, &bytes, &allocations,
+                       &allocated_bytes, &parse_calls, &parse_ns, &align_calls,
+                       &align_ns, &align_buffered}) {
+      c->store(0, std::memory_order_relaxed);
+    }
+  }
+
+  const std::string fmt;
+  Counter format_calls{0};
+  Counter format_ns{0};
+  Counter bytes{0};
+  Counter allocations{0};
+  Counter allocated_bytes{0};
+  Counter parse_calls{0};
+  Counter parse_ns{0};
+  Counter align_calls{0};
+  Counter align_ns{0};
+  Counter align_buffered{0};
+};
+
+// 当前线程中库内部内存分配的累计次数和字节数。
+struct AllocationCounts {
+  size_t count = 0;
+  size_t bytes = 0;
+};
+
+inline auto ThreadAllocations() -> AllocationCounts& {
+  thread_local AllocationCounts counts;
+  return counts;
+}
+
+// 库内部分配内存时调用。关闭插桩时为空操作。
+inline void NoteAllocation(size_t bytes) {
+#if FORMATV_INSTRUMENT
+  AllocationCounts& counts = ThreadAllocations();
+  ++counts.count;
+  counts.bytes += bytes;
+#else
+  static_cast<void>(bytes);
+#endif
+}
+
+// 容器扩容后调用：容量发生变化即视为一次分配。
+inline void NoteGrowth(size_t old_capacity, size_t new_capacity,
+                       size_t element_size = 1) {
+  if (new_capacity != old_capacity) {
+    NoteAllocation(new_capacity * element_size);
+  }
+}
+
+// 当前线程正在执行的 format 所属的计数器，供 FormatAlign 归属字段的耗时。
+inline auto CurrentSite() -> InstrumentCounters*& {
+  thread_local InstrumentCounters* site = nullptr;
+  return site;
+}
+
+}  // namespace Internal
+
+// 进程级的插桩数据，以格式字符串的地址为键聚合：
+// 同一个字面量经过格式字符串缓存后共享一份解析结果，因此只对应一个条目。
+// 关闭 FORMATV_INSTRUMENT 时这里不会被调用，Snapshot() 返回空表。
+class InstrumentRegistry {
+ public:
+  static constexpr bool Enabled = FORMATV_INSTRUMENT != 0;
+  // 非字面量的格式字符串每次都重新解析，地址各不相同；
+  // 条目超过 MaxSites 后，新出现的格式字符串都计入 "<other>"。
+  static constexpr size_t MaxSites = 1024;
+
+  static auto Instance() -> InstrumentRegistry& {
+    static InstrumentRegistry registry;
+    return registry;
+  }
+
+  // key 对应的计数器。key 是格式字符串或替换项表的地址，这块内存释放后
+  // 可能被另一个格式字符串重用，所以命中时还要用 matches(fmt) 确认条目的
+  // 文本没有变化，不同时视为未命中。未命中时调用 label() 得到文本，
+  // 同一文本在不同地址出现时合并到一个条目。
+  // 只有新建条目的地址才登记到索引和线程缓存中，之后的调用不加锁；
+  // 两者的大小因此也不超过 MaxSites。按文本合并的或计入 "<other>" 的地址
+  // 不登记，不断产生新地址的格式字符串（非字面量、反复创建的 FormatTemplate）
+  // 每次都加锁查找，但不会让插桩占用的内存无限增长。
+  template <typename Matches, typename Label>
+  auto Site(const void* key, const Matches& matches, Label&& label)
+      -> Internal::InstrumentCounters* {
+    thread_local std::unordered_map<const void*,
+                                    Internal::InstrumentCounters*>
+        cache;
+    auto cached = cache.find(key);
+    if (cached != cache.end() && matches(cached->second->fmt)) {
+      return cached->second;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Internal::InstrumentCounters* site = nullptr;
+    auto it = index_.find(key);
+    if (it != index_.end() && matches(it->second->fmt)) {
+      site = it->second;
+    } else {
+      std::string text = label();
+      auto named = by_text_.find(text);
+      if (named != by_text_.end()) {
+        return named->second;
+      }
+      if (sites_.size() >= MaxSites) {
+        return &other_;
+      }
+      sites_.push_back(
+          std::make_unique<Internal::InstrumentCounters>(std::move(text)));
+      site = sites_.back().get();
+      by_text_.emplace(site->fmt, site);
+      index_[key] = site;
+    }
+    cache[key] = site;
+    return site;
+  }
+
+  // 文本已知时的简写。
+  auto Site(const void* key, std::string_view text)
+      -> Internal::InstrumentCounters* {
+    return Site(
+        key, [text](std::string_view fmt) { return fmt == text; },
+        [text] { return std::string(text); });
+  }
+
+  // 不在任何 format 调用中的 FormatAlign，例如 vformat_to 和批量格式化。
+  auto Unattributed() -> Internal::InstrumentCounters* {
+    return &unattributed_;
+  }
+
+  // 所有有数据的条目，按 format 和解析的总耗时从高到低排列。
+  auto Snapshot() const -> std::vector<InstrumentSite> {
+    std::vector<InstrumentSite> result;
+    auto collect = [&](const Internal::InstrumentCounters& counters) {
+      InstrumentSite site = counters.Load();
+      if (site.format_calls + site.parse_calls + site.align_calls != 0) {
+        result.push_back(std::move(site));
+      }
+    };
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (const auto& site : sites_) {
+        collect(*site);
+      }
+    }
+    collect(other_);
+    collect(unattributed_);
+    std::stable_sort(result.begin(), result.end(),
+                     [](const InstrumentSite& a, const InstrumentSite& b) {
+                       return a.format_ns + a.parse_ns >
+                              b.format_ns + b.parse_ns;
+                     });
+    return result;
+  }
+
+  // 清零所有计数。条目本身保留，其他线程缓存的指针仍然有效。
+  void Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& site : sites_) {
+      site->Reset();
+    }
+    other_.Reset();
+    unattributed_.Reset();
+  }
+
+  // 以对齐的文本表格输出快照，每行一个格式字符串。
+  auto DumpText() const -> std::string {
+    std::string out =
+        "     calls   total us   ns/call      bytes   allocs   parses"
+        "   fields  buffered  fmt\n";
+    for (const auto& site : Snapshot()) {
+      uint64_t per_call =
+          site.format_calls == 0 ? 0 : site.format_ns / site.format_calls;
+      AppendColumn(out, site.format_calls, 10);
+      AppendColumn(out, (site.format_ns + site.parse_ns) / 1000, 11);
+      AppendColumn(out, per_call, 10);
+      AppendColumn(out, site.bytes, 11);
+      AppendColumn(out, site.allocations, 9);
+      AppendColumn(out, site.parse_calls, 9);
+      AppendColumn(out, site.align_calls, 9);
+      AppendColumn(out, site.align_buffered, 10);
+      out += "  ";
+      AppendEscaped(out, site.fmt);
+      out += '\n';
+    }
+    return out;
+  }
+
+  // 以 JSON 数组输出快照，字段名与 InstrumentSite 的成员相同。
+  auto DumpJson() const -> std::string {
+    std::string out = "[";
+    const char* separator = "\n";
+    for (const auto& site : Snapshot()) {
+      out += separator;
+      out += "  {\"fmt\": \"";
+      AppendEscaped(out, site.fmt);
+      out += '"';
+      std::pair<const char*, uint64_t> fields[] = {
+          {"format_calls", site.format_calls},
+          {"format_ns", site.format_ns},
+          {"bytes", site.bytes},
+          {"allocations", site.allocations},
+          {"allocated_bytes", site.allocated_bytes},
+          {"parse_calls", site.parse_calls},
+          {"parse_ns", site.parse_ns},
+          {"align_calls", site.align_calls},
+          {"align_ns", site.align_ns},
+          {"align_buffered", site.align_buffered},
+      };
+      for (const auto& [name, value] : fields) {
+        out += ", \"";
+        out += name;
+        out += "\": ";
+        AppendColumn(out, value, 0);
+      }
+      out += '}';
+      separator = ",\n";
+    }
+    out += "\n]\n";
+    return out;
+  }
+
+ private:
+  InstrumentRegistry() = default;
+
+  // 右对齐到 width 列的十进制数。
+  static void AppendColumn(std::string& out, uint64_t value, size_t width) {
+    char buffer[20];
+    auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+    size_t size = end - buffer;
+    out.append(width > size ? width - size : 0, ' ');
+    out.append(buffer, size);
+  }
+
+  // 按 JSON 字符串的规则转义，文本表格中也用它保证每个条目只占一行。
+  static void AppendEscaped(std::string& out, std::string_view text) {
+    static constexpr char Hex[] = "0123456789abcdef";
+    for (char c : text) {
+      auto u = static_cast<unsigned char>(c);
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (c == '\n') {
+        out += "\\n";
+      } else if (c == '\t') {
+        out += "\\t";
+      } else if (u < 0x20) {
+        out += "\\u00";
+        out += Hex[u >> 4];
+        out += Hex[u & 0xf];
+      } else {
+        out += c;
+      }
+    }
+  }
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Internal::InstrumentCounters>> sites_;
+  std::unordered_map<const void*, Internal::InstrumentCounters*> index_;
+  // 以文本为键的索引，键指向条目自己保存的 fmt。
+  std::unordered_map<std::string_view, Internal::InstrumentCounters*>
+      by_text_;
+  Internal::InstrumentCounters other_{"<other>"};
+  Internal::InstrumentCounters unattributed_{"<unattributed>"};
+};
+
+namespace Internal {
+
+#if FORMATV_INSTRUMENT
+
+inline auto InstrumentNow() -> uint64_t {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// 统计一次 format 调用：次数、耗时和其间发生的库内部分配。
+// resolve() 返回这次调用所属的条目，只在开启插桩时调用。
+// 同一格式字符串的嵌套作用域（str() 内部调用 format()）只计一次，
+// 但输出的字节数仍然累加到该条目上。
+class FormatSiteScope {
+ public:
+  template <typename Resolve>
+  explicit FormatSiteScope(Resolve&& resolve)
+      : site_(resolve()),
+        parent_(CurrentSite()),
+        active_(parent_ != site_),
+        allocations_(ThreadAllocations()),
+        start_(InstrumentNow()) {
+    CurrentSite() = site_;
+  }
+
+  FormatSiteScope(const FormatSiteScope&) = delete;
+  auto operator=(const FormatSiteScope&) -> FormatSiteScope& = delete;
+
+  ~FormatSiteScope() {
+    CurrentSite() = parent_;
+    if (!active_) {
+      return;
+    }
+    const AllocationCounts& now = ThreadAllocations();
+    site_->Add(site_->format_calls, 1);
+    site_->Add(site_->format_ns, InstrumentNow() - start_);
+    site_->Add(site_->allocations, now.count - allocations_.count);
+    site_->Add(site_->allocated_bytes, now.bytes - allocations_.bytes);
+  }
+
+  void AddBytes(size_t bytes) { site_->Add(site_->bytes, bytes); }
+
+ private:
+  InstrumentCounters* site_;
+  InstrumentCounters* parent_;
+  bool active_;
+  AllocationCounts allocations_;
+  uint64_t start_;
+};
+
+// 统计一次运行期解析，以被解析的字符串地址为键。
+class ParseScope {
+ public:
+  explicit ParseScope(std::string_view fmt)
+      : site_(InstrumentRegistry::Instance().Site(fmt.data(), fmt)),
+        allocations_(ThreadAllocations()),
+        start_(InstrumentNow()) {}
+
+  ParseScope(const ParseScope&) = delete;
+  auto operator=(const ParseScope&) -> ParseScope& = delete;
+
+  ~ParseScope() {
+    const AllocationCounts& now = ThreadAllocations();
+    site_->Add(site_->parse_calls, 1);
+    site_->Add(site_->parse_ns, InstrumentNow() - start_);
+    site_->Add(site_->allocations, now.count - allocations_.count);
+    site_->Add(site_->allocated_bytes, now.bytes - allocations_.bytes);
+  }
+
+ private:
+  InstrumentCounters* site_;
+  AllocationCounts allocations_;
+  uint64_t start_;
+};
+
+// 统计一个带宽度的字段，计入当前 format 调用所属的条目。
+class AlignScope {
+ public:
+  AlignScope()
+      : site_(CurrentSite() != nullptr
+                  ? CurrentSite()
+                  : InstrumentRegistry::Instance().Unattributed()),
+        start_(InstrumentNow()) {}
+
+  AlignScope(const AlignScope&) = delete;
+  auto operator=(const AlignScope&) -> AlignScope& = delete;
+
+  ~AlignScope() {
+    site_->Add(site_->align_calls, 1);
+    site_->Add(site_->align_ns, InstrumentNow() - start_);
+  }
+
+  // 这个字段需要先写入临时缓冲区。
+  void Buffered() { site_->Add(site_->align_buffered, 1); }
+
+ private:
+  InstrumentCounters* site_;
+  uint64_t start_;
+};
+
+#else
+
+// 关闭插桩时的空实现，接口与上面相同，编译器会将其完全消除。
+class FormatSiteScope {
+ public:
+  template <typename Resolve>
+  explicit FormatSiteScope(Resolve&& /*resolve*/) {}
+  void AddBytes(size_t /*bytes*/) {}
+};
+
+class ParseScope {
+ public:
+  explicit ParseScope(std::string_view /*fmt*/) {}
+};
+
+class AlignScope {
+ public:
+  AlignScope() {}
+  void Buffered() {}
+};
+
+#endif  // FORMATV_INSTRUMENT
+
+}  // namespace Internal
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_INSTRUMENT_H
@@ -0,0 +1,344 @@
+#ifndef FORMATV_FORMAT_LOGGER_H
+#define FORMATV_FORMAT_LOGGER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "FormatArgs.h"
+#include "FormatProviders.h"
+#include "FormatSink.h"
+#include "FormatVariadic.h"
+
+namespace Formatv {
+
+// 环形队列写满时生产者的处理方式。
+enum class OverflowPolicy : uint8_t {
+  Drop,   // 丢弃这条日志并计数，生产者从不等待。
+  Block,  // 等待消费者腾出空间。
+};
+
+namespace Internal {
+
+// 日志参数在槽中的存储方式：字符串复制其内容，其余类型复制构造一份。
+template <typename T>
+using LogDecayed = std::decay_t<const T>;
+
+template <typename T>
+using LogView = std::conditional_t<IsStringLike<LogDecayed<T>>::value,
+                                   std::string_view, const LogDecayed<T>&>;
+
+// 把参数依次写入槽的负载区。data 为 nullptr 时只计算所需的字节数。
+class LogPayloadWriter {
+ public:
+  explicit LogPayloadWriter(char* data) : data_(data) {}
+
+  template <typename T>
+  void Put(const T& value) {
+    using Decayed = LogDecayed<T>;
+    if constexpr (IsStringLike<Decayed>::value) {
+      const Decayed& str = value;
+      std::string_view view = ToStringView(str);
+      size_t size = view.size();
+      Align(alignof(size_t));
+      if (data_ != nullptr) {
+        std::memcpy(data_ + pos_, &size, sizeof(size));
+        std::memcpy(data_ + pos_ + sizeof(size), view.data(), size);
+      }
+      pos_ += sizeof(size) + size;
+    } else {
+      static_assert(alignof(Decayed) <= alignof(std::max_align_t),
+                    "Over-aligned log arguments are not supported!");
+      Align(alignof(Decayed));
+      if (data_ != nullptr) {
+        new (data_ + pos_) Decayed(value);
+      }
+      pos_ += sizeof(Decayed);
+    }
+  }
+
+  auto size() const -> size_t { return pos_; }
+
+ private:
+  void Align(size_t alignment) {
+    pos_ = (pos_ + alignment - 1) / alignment * alignment;
+  }
+
+  char* data_;
+  size_t pos_ = 0;
+};
+
+// 按写入的顺序从负载区取回参数的视图。
+class LogPayloadReader {
+ public:
+  explicit LogPayloadReader(char* data) : data_(data) {}
+
+  template <typename T>
+  auto Get() -> LogView<T> {
+    using Decayed = LogDecayed<T>;
+    if constexpr (IsStringLike<Decayed>::value) {
+      size_t size;
+      Align(alignof(size_t));
+      std::memcpy(&size, data_ + pos_, sizeof(size));
+      std::string_view view(data_ + pos_ + sizeof(size), size);
+      pos_ += sizeof(size) + size;
+      return view;
+    } else {
+      Align(alignof(Decayed));
+      auto* value = std::launder(reinterpret_cast<Decayed*>(data_ + pos_));
+      pos_ += sizeof(Decayed);
+      return *value;
+    }
+  }
+
+ private:
+  void Align(size_t alignment) {
+    pos_ = (pos_ + alignment - 1) / alignment * alignment;
+  }
+
+  char* data_;
+  size_t pos_ = 0;
+};
+
+template <typename T>
+void DestroyLogArg(LogView<T> view) {
+  using Decayed = LogDecayed<T>;
+  if constexpr (!IsStringLike<Decayed>::value &&
+                !std::is_trivially_destructible_v<Decayed>) {
+    const_cast<Decayed&>(view).~Decayed();
+  }
+}
+
+// 在消费者线程上取回参数，通过 FormatvObjectBase 格式化，然后销毁参数。
+template <typename... Ts>
+void RenderLogRecord(const char* fmt, char* payload, FormatSink& os) {
+  LogPayloadReader reader(payload);
+  // 花括号初始化保证按从左到右的顺序读取。
+  std::tuple<LogView<Ts>...> views{reader.Get<Ts>()...};
+  std::apply(
+      [&](const auto&... vals) {
+        vformatv(fmt, make_format_args(vals...)).format(os);
+      },
+      views);
+  std::apply([](const auto&... vals) { (DestroyLogArg<Ts>(vals), ...); },
+             views);
+}
+
+// 负载放不下时，生产者退回到同步格式化，负载区保存截断后的文本。
+inline void RenderLogText(const char* /*fmt*/, char* payload, FormatSink& os) {
+  size_t size;
+  std::memcpy(&size, payload, sizeof(size));
+  os.write(payload + sizeof(size), size);
+}
+
+}  // namespace Internal
+
+// 异步日志前端：生产者线程只把格式字符串和参数复制进环形队列的槽中，
+// 格式化和输出都在后台的消费者线程上完成。
+//   AsyncLogger<> logger(sink);
+//   logger.log("request {0} took {1} us", id, elapsed);
+// 队列是固定大小的多生产者单消费者无锁环形缓冲（每个槽带序号），
+// 内存在构造时一次分配。数值等可平凡复制的参数直接按值复制，
+// 字符串复制其内容，因此生产者路径上没有内存分配。
+// fmt 只保存指针，必须是在日志器整个生命周期内有效的字符串字面量。
+// 所有参数编码后超过 PayloadSize 的日志在生产者线程上同步格式化，
+// 文本仍然放不下时截断，条数由 truncated() 报告。
+template <size_t PayloadSize = 192>
+class AsyncLogger {
+ public:
+  struct Options {
+    // 槽的个数，向上取整为 2 的幂。
+    size_t capacity = 4096;
+    OverflowPolicy policy = OverflowPolicy::Drop;
+    // 队列为空时消费者的休眠时间。
+    std::chrono::microseconds idle_sleep{50};
+  };
+
+  explicit AsyncLogger(FormatSink& out) : AsyncLogger(out, Options()) {}
+
+  AsyncLogger(FormatSink& out, const Options& options)
+      : out_(out), options_(options) {
+    size_t capacity = 2;
+    while (capacity < options.capacity) {
+      capacity *= 2;
+    }
+    mask_ = capacity - 1;
+    slots_.reset(new Slot[capacity]);
+    for (size_t i = 0; i < capacity; ++i) {
+      slots_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    consumer_ = std::thread([this] { Consume(); });
+  }
+
+  AsyncLogger(const AsyncLogger&) = delete;
+  auto operator=(const AsyncLogger&) -> AsyncLogger& = delete;
+
+  // 输出所有已提交的日志后停止消费者线程。
+  ~AsyncLogger() {
+    stop_.store(true, std::memory_order_release);
+    consumer_.join();
+  }
+
+  // 提交一条日志。按 Drop 策略丢弃时返回 false。
+  template <typename... Ts>
+  auto log(const char* fmt, const Ts&... vals) -> bool {
+    Slot* slot = Acquire();
+    if (slot == nullptr) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    Internal::LogPayloadWriter measure(nullptr);
+    (measure.Put(vals), ...);
+    slot->fmt = fmt;
+    if (measure.size() <= PayloadSize) {
+      Internal::LogPayloadWriter writer(slot->payload);
+      (writer.Put(vals), ...);
+      slot->render = &Internal::RenderLogRecord<Ts...>;
+    } else {
+      FixedBufferSink sink(slot->payload + sizeof(size_t),
+                           PayloadSize - sizeof(size_t));
+      formatv_ref(fmt, vals...).format(sink);
+      size_t size = sink.written();
+      std::memcpy(slot->payload, &size, sizeof(size));
+      if (sink.truncated()) {
+        truncated_.fetch_add(1, std::memory_order_relaxed);
+      }
+      slot->render = &Internal::RenderLogText;
+    }
+    Publish(slot);
+    return true;
+  }
+
+  // 等待此前提交的日志全部输出并刷新 sink。消费者写完 target 之前的日志
+  // 后立即刷新，即使队列中仍有其他生产者新提交的日志。
+  void Flush() {
+    size_t target = enqueue_pos_.load(std::memory_order_acquire);
+    size_t requested = flush_target_.load(std::memory_order_relaxed);
+    while (requested < target &&
+           !flush_target_.compare_exchange_weak(requested, target,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed)) {
+    }
+    while (flushed_pos_.load(std::memory_order_acquire) < target) {
+      std::this_thread::yield();
+    }
+  }
+
+  // 因队列已满被丢弃的日志条数。
+  auto dropped() const -> size_t {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+  // 负载放不下、同步格式化后又超过 PayloadSize 而被截断的日志条数。
+  auto truncated() const -> size_t {
+    return truncated_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  using RenderFn = void (*)(const char* fmt, char* payload, FormatSink& os);
+
+  struct alignas(64) Slot {
+    std::atomic<size_t> sequence{0};
+    // 槽被提交时的入队位置，供 Publish 计算序号。
+    size_t position = 0;
+    const char* fmt = nullptr;
+    RenderFn render = nullptr;
+    alignas(std::max_align_t) char payload[PayloadSize];
+  };
+
+  // 占用一个空闲槽。队列已满且策略为 Drop 时返回 nullptr。
+  auto Acquire() -> Slot* {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot& slot = slots_[pos & mask_];
+      size_t seq = slot.sequence.load(std::memory_order_acquire);
+      auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+          slot.position = pos;
+          return &slot;
+        }
+      } else if (diff < 0) {
+        if (options_.policy == OverflowPolicy::Drop) {
+          return nullptr;
+        }
+        std::this_thread::yield();
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  void Publish(Slot* slot) {
+    slot->sequence.store(slot->position + 1, std::memory_order_release);
+  }
+
+  // 消费者线程：依次格式化已提交的槽，空闲或写完 Flush() 请求的位置时
+  // 刷新 sink。
+  void Consume() {
+    size_t pos = 0;
+    size_t published = 0;
+    while (true) {
+      Slot& slot = slots_[pos & mask_];
+      if (slot.sequence.load(std::memory_order_acquire) == pos + 1) {
+        slot.render(slot.fmt, slot.payload, out_);
+        out_.put('\n');
+        slot.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        ++pos;
+        size_t target = flush_target_.load(std::memory_order_acquire);
+        if (target > published && pos >= target) {
+          PublishFlushed(pos);
+          published = pos;
+        }
+        continue;
+      }
+
+      // 空闲时只在有新输出的情况下刷新，避免每次醒来都调用一次 Flush()。
+      if (pos != published) {
+        PublishFlushed(pos);
+        published = pos;
+      }
+      if (stop_.load(std::memory_order_acquire) &&
+          enqueue_pos_.load(std::memory_order_acquire) == pos) {
+        return;
+      }
+      std::this_thread::sleep_for(options_.idle_sleep);
+    }
+  }
+
+  // 先刷新 sink，再公布 pos 之前的日志已经输出。
+  void PublishFlushed(size_t pos) {
+    out_.Flush();
+    flushed_pos_.store(pos, std::memory_order_release);
+  }
+
+  FormatSink& out_;
+  Options options_;
+  std::unique_ptr<Slot[]> slots_;
+  size_t mask_ = 0;
+
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> flushed_pos_{0};
+  // Flush() 请求刷新到的位置，只增不减。
+  std::atomic<size_t> flush_target_{0};
+  std::atomic<size_t> dropped_{0};
+  std::atomic<size_t> truncated_{0};
+  std::atomic<bool> stop_{false};
+  std::thread consumer_;
+};
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_LOGGER_H
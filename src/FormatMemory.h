@@ -0,0 +1,271 @@
+#ifndef FORMATV_FORMAT_MEMORY_H
+#define FORMATV_FORMAT_MEMORY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "FormatSink.h"
+
+namespace Formatv {
+
+// 线程本地的 bump 分配器，用于格式化过程中的临时内存。
+// 分配只移动指针，释放以 ScratchScope 为单位整体回退；
+// 内存块在回退后保留，稳态下不再调用 malloc/free。
+// 与 BufferPool 一样限制保留的内存：回退时空闲的块超过 MaxRetained 的部分
+// 立即释放，一次很宽的字段不会让内存在线程的整个生命周期内一直被占用。
+class ScratchArena {
+ public:
+  static constexpr size_t BlockSize = 4096;
+  static constexpr size_t MaxRetained = 64 * 1024;
+
+  // 回退点：已使用的块数和当前块中的位置。
+  struct Marker {
+    size_t blocks;
+    char* cur;
+  };
+
+  ScratchArena() = default;
+  ScratchArena(const ScratchArena&) = delete;
+  auto operator=(const ScratchArena&) -> ScratchArena& = delete;
+
+  static auto ThreadLocal() -> ScratchArena& {
+    thread_local ScratchArena arena;
+    return arena;
+  }
+
+  auto Allocate(size_t size, size_t align = alignof(std::max_align_t))
+      -> char* {
+    if (char* p = TryAllocate(size, align)) {
+      return p;
+    }
+    NextBlock(size + align);
+    return TryAllocate(size, align);
+  }
+
+  auto mark() const -> Marker { return {used_, cur_}; }
+
+  // 释放 marker 之后分配的所有内存。
+  void release(Marker marker) {
+    used_ = marker.blocks;
+    cur_ = marker.cur;
+    end_ = used_ == 0 ? nullptr
+                      : blocks_[used_ - 1].data.get() + blocks_[used_ - 1].size;
+    Trim();
+  }
+
+  void Reset() { release({0, nullptr}); }
+
+  // 持有的内存总量，包括当前未使用的块。
+  auto capacity() const -> size_t { return capacity_; }
+
+ private:
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+
+  auto TryAllocate(size_t size, size_t align) -> char* {
+    if (cur_ == nullptr) {
+      return nullptr;
+    }
+    auto addr = reinterpret_cast<uintptr_t>(cur_);
+    size_t skip = (align - addr % align) % align;
+    if (skip + size > static_cast<size_t>(end_ - cur_)) {
+      return nullptr;
+    }
+    char* p = cur_ + skip;
+    cur_ = p + size;
+    return p;
+  }
+
+  // 切换到下一个至少有 size 字节的块，已有的块不够大时在此处插入新块。
+  void NextBlock(size_t size) {
+    if (used_ == blocks_.size() || blocks_[used_].size < size) {
+      size_t block_size = std::max(size, BlockSize);
+      if (!blocks_.empty()) {
+        block_size = std::max(block_size, blocks_.back().size);
+      }
+      Block block{std::unique_ptr<char[]>(new char[block_size]), block_size};
+      Internal::NoteAllocation(block_size);
+      blocks_.insert(blocks_.begin() + used_, std::move(block));
+      capacity_ += block_size;
+    }
+    Block& block = blocks_[used_++];
+    cur_ = block.data.get();
+    end_ = cur_ + block.size;
+  }
+
+  // 总量超过 MaxRetained 时释放未使用的块：先释放本身就超过上限的块，
+  // 仍然超出时再从后往前释放。正在使用的块不受影响。
+  void Trim() {
+    for (size_t i = blocks_.size(); i > used_ && capacity_ > MaxRetained;
+         --i) {
+      if (blocks_[i - 1].size > MaxRetained) {
+        capacity_ -= blocks_[i - 1].size;
+        blocks_.erase(blocks_.begin() + (i - 1));
+      }
+    }
+    while (capacity_ > MaxRetained && blocks_.size() > used_) {
+      capacity_ -= blocks_.back().size;
+      blocks_.pop_back();
+    }
+  }
+
+  std::vector<Block> blocks_;
+  // 正在使用的块数，最后一个是当前块。
+  size_t used_ = 0;
+  // 所有块的总字节数。
+  size_t capacity_ = 0;
+  char* cur_ = nullptr;
+  char* end_ = nullptr;
+};
+
+// 作用域内从 ScratchArena 分配的内存在离开作用域时全部释放。
+// 作用域可以嵌套，按栈的顺序回退。
+class ScratchScope {
+ public:
+  explicit ScratchScope(ScratchArena& arena = ScratchArena::ThreadLocal())
+      : arena_(arena), marker_(arena.mark()) {}
+
+  ScratchScope(const ScratchScope&) = delete;
+  auto operator=(const ScratchScope&) -> ScratchScope& = delete;
+
+  ~ScratchScope() { arena_.release(marker_); }
+
+ private:
+  ScratchArena& arena_;
+  ScratchArena::Marker marker_;
+};
+
+// 先写入 N 字节的内联缓冲区，超出时转移到 ScratchArena 中。
+// 与 InlineBufferSink 相同，但溢出后不调用 malloc；只能在 ScratchScope 内使用。
+// 内容超过 limit 字节后不再保存，只计入 count()，此时 truncated() 为 true，
+// data() 和 view() 不再有意义。
+template <size_t N>
+class ScratchBufferSink final : public FormatSink {
+ public:
+  explicit ScratchBufferSink(size_t limit = static_cast<size_t>(-1))
+      : limit_(limit) {
+    SetBuffer(inline_, inline_, inline_ + N);
+  }
+
+  auto data() const -> const char* { return begin_; }
+  auto size() const -> size_t { return cur_ - begin_; }
+  auto view() const -> std::string_view { return {begin_, size()}; }
+  auto truncated() const -> bool { return truncated_; }
+
+  void clear() {
+    cur_ = begin_;
+    flushed_ = 0;
+    truncated_ = false;
+  }
+
+ private:
+  void Overflow(size_t hint) override {
+    size_t used = cur_ - begin_;
+    if (truncated_ || used + hint > limit_) {
+      truncated_ = true;
+      flushed_ += used;
+      SetBuffer(inline_, inline_, inline_ + N);
+      return;
+    }
+    size_t capacity =
+        std::min(std::max<size_t>(2 * (end_ - begin_), used + hint), limit_);
+    char* buffer = ScratchArena::ThreadLocal().Allocate(capacity, 1);
+    std::memcpy(buffer, begin_, used);
+    SetBuffer(buffer, buffer + used, buffer + capacity);
+  }
+
+  size_t limit_;
+  bool truncated_ = false;
+  char inline_[N];
+};
+
+class BufferPool;
+
+// 从 BufferPool 借出的字符串缓冲区，析构时清空并归还。
+class PooledBuffer {
+ public:
+  PooledBuffer(PooledBuffer&& rhs) noexcept
+      : pool_(std::exchange(rhs.pool_, nullptr)),
+        buffer_(std::move(rhs.buffer_)) {}
+  PooledBuffer(const PooledBuffer&) = delete;
+  auto operator=(const PooledBuffer&) -> PooledBuffer& = delete;
+  auto operator=(PooledBuffer&&) -> PooledBuffer& = delete;
+
+  inline ~PooledBuffer();
+
+  auto str() -> std::string& { return buffer_; }
+  auto view() const -> std::string_view { return buffer_; }
+  auto data() const -> const char* { return buffer_.data(); }
+  auto size() const -> size_t { return buffer_.size(); }
+
+ private:
+  friend class BufferPool;
+
+  PooledBuffer(BufferPool* pool, std::string buffer)
+      : pool_(pool), buffer_(std::move(buffer)) {}
+
+  BufferPool* pool_;
+  std::string buffer_;
+};
+
+// 可复用的输出缓冲区池。缓冲区归还时保留容量，
+// 之后借出的缓冲区直接在原有空间上格式化，不再分配内存。
+// 超过 MaxRetained 的缓冲区归还时直接释放，池中最多保留 MaxBuffers 个。
+class BufferPool {
+ public:
+  static constexpr size_t MaxBuffers = 8;
+  static constexpr size_t MaxRetained = 64 * 1024;
+
+  BufferPool() = default;
+  BufferPool(const BufferPool&) = delete;
+  auto operator=(const BufferPool&) -> BufferPool& = delete;
+
+  static auto ThreadLocal() -> BufferPool& {
+    thread_local BufferPool pool;
+    return pool;
+  }
+
+  // 借出一个空的缓冲区。
+  auto Acquire() -> PooledBuffer {
+    if (count_ == 0) {
+      return PooledBuffer(this, std::string());
+    }
+    return PooledBuffer(this, std::move(free_[--count_]));
+  }
+
+  // 池中空闲的缓冲区个数。
+  auto size() const -> size_t { return count_; }
+
+ private:
+  friend class PooledBuffer;
+
+  void Release(std::string&& buffer) {
+    if (count_ == MaxBuffers || buffer.capacity() > MaxRetained) {
+      return;
+    }
+    buffer.clear();
+    free_[count_++] = std::move(buffer);
+  }
+
+  std::string free_[MaxBuffers];
+  size_t count_ = 0;
+};
+
+inline PooledBuffer::~PooledBuffer() {
+  if (pool_ != nullptr) {
+    pool_->Release(std::move(buffer_));
+  }
+}
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_MEMORY_H
@@ -0,0 +1,499 @@
+#ifndef FORMATV_FORMAT_PROVIDERS_H
+#define FORMATV_FORMAT_PROVIDERS_H
+
+#include <algorithm>
+#include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "FormatSink.h"
+#include "FormatUtil.h"
+#include "FormatVariadicDetails.h"
+
+namespace Formatv {
+
+namespace Internal {
+
+template <typename T>
+struct IsStringLike
+    : std::integral_constant<bool, std::is_same_v<T, const char*> ||
+                                       std::is_same_v<T, char*> ||
+                                       std::is_same_v<T, std::string> ||
+                                       std::is_same_v<T, std::string_view>> {};
+
+template <typename T>
+auto ToStringView(const T& value) -> std::string_view {
+  if constexpr (std::is_pointer_v<T>) {
+    return value == nullptr ? std::string_view() : std::string_view(value);
+  } else {
+    return std::string_view(value);
+  }
+}
+
+enum class IntegerStyle : uint8_t {
+  Decimal,  // "D" / "d" / 空
+  Grouped,  // "N" / "n"，每三位插入一个 `,`
+  HexLower, // "x"
+  HexUpper, // "X"
+  Binary,   // "b" / "B"
+};
+
+struct IntegerOptions {
+  IntegerStyle style = IntegerStyle::Decimal;
+  bool prefix = false;
+  // 最少输出的数字个数（不含前缀和符号），不足时在前面补 0。
+  size_t digits = 0;
+};
+
+// 整数选项的语法为 [style][digits]：
+//   x- / X-      十六进制，无前缀
+//   x+ / x / X   十六进制，带 0x 前缀（X 使用大写数字）
+//   b- / b / B   二进制，b- 无前缀，其余带 0b 前缀
+//   N / n        按千分位分组，digits 被忽略
+//   D / d / 空   十进制
+constexpr auto ParseIntegerOptions(std::string_view options)
+    -> IntegerOptions {
+  IntegerOptions result;
+  if (options.empty()) {
+    return result;
+  }
+
+  switch (options.front()) {
+    case 'x':
+    case 'X':
+    case 'b':
+    case 'B':
+      result.style = options.front() == 'x'   ? IntegerStyle::HexLower
+                     : options.front() == 'X' ? IntegerStyle::HexUpper
+                                              : IntegerStyle::Binary;
+      options.remove_prefix(1);
+      result.prefix = true;
+      if (!options.empty() &&
+          (options.front() == '-' || options.front() == '+')) {
+        result.prefix = options.front() == '+';
+        options.remove_prefix(1);
+      }
+      break;
+    case 'N':
+    case 'n':
+      result.style = IntegerStyle::Grouped;
+      options.remove_prefix(1);
+      break;
+    case 'D':
+    case 'd':
+      options.remove_prefix(1);
+      break;
+    default:
+      break;
+  }
+
+  if (!options.empty() &&
+      FormatUtil::ConsumeInteger(options, 10, result.digits)) {
+    assert(false && "Invalid integral format style!");
+  }
+  return result;
+}
+
+// 两位一组的十进制数字表，每次除以 100 输出两位。
+inline constexpr char DigitPairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// 从 end 向前写入 value 的十进制表示，返回第一个字符的位置。
+inline auto WriteDecimal(char* end, uint64_t value) -> char* {
+  while (value >= 100) {
+    size_t pair = (value % 100) * 2;
+    value /= 100;
+    *--end = DigitPairs[pair + 1];
+    *--end = DigitPairs[pair];
+  }
+  if (value >= 10) {
+    size_t pair = value * 2;
+    *--end = DigitPairs[pair + 1];
+    *--end = DigitPairs[pair];
+  } else {
+    *--end = static_cast<char>('0' + value);
+  }
+  return end;
+}
+
+// 从 end 向前写入 value 的 2^shift 进制表示，返回第一个字符的位置。
+inline auto WritePowerOfTwo(char* end, uint64_t value, unsigned shift,
+                            bool upper) -> char* {
+  const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+  const uint64_t mask = (uint64_t{1} << shift) - 1;
+  do {
+    *--end = digits[value & mask];
+    value >>= shift;
+  } while (value != 0);
+  return end;
+}
+
+// 整数格式化结果的最大长度：符号、前缀、64 位二进制数字以及分组符号。
+inline constexpr size_t MaxIntegerSize = 128;
+
+// value 的十进制位数。
+inline auto DecimalDigits(uint64_t value) -> size_t {
+  size_t digits = 1;
+  while (value >= 10000) {
+    value /= 10000;
+    digits += 4;
+  }
+  if (value >= 1000) {
+    return digits + 3;
+  }
+  if (value >= 100) {
+    return digits + 2;
+  }
+  return value >= 10 ? digits + 1 : digits;
+}
+
+// 十六进制和二进制输出的值：负数取原类型宽度的补码。
+inline auto PowerOfTwoValue(uint64_t magnitude, bool negative, unsigned bits)
+    -> uint64_t {
+  if (!negative) {
+    return magnitude;
+  }
+  uint64_t value = 0 - magnitude;
+  if (bits < 64) {
+    value &= (uint64_t{1} << bits) - 1;
+  }
+  return value;
+}
+
+// 将整数格式化到 buffer 的末尾，返回结果的起始位置。
+// magnitude 是绝对值；bits 是原类型的位数，用于负数的十六进制/二进制补码。
+inline auto FormatIntegerTo(char (&buffer)[MaxIntegerSize], uint64_t magnitude,
+                            bool negative, unsigned bits,
+                            std::string_view options) -> char* {
+  IntegerOptions opts = ParseIntegerOptions(options);
+  char* end = buffer + MaxIntegerSize;
+  char* begin = end;
+
+  switch (opts.style) {
+    case IntegerStyle::HexLower:
+    case IntegerStyle::HexUpper:
+    case IntegerStyle::Binary: {
+      uint64_t value = PowerOfTwoValue(magnitude, negative, bits);
+      bool binary = opts.style == IntegerStyle::Binary;
+      begin = WritePowerOfTwo(end, value, binary ? 1 : 4,
+                              opts.style == IntegerStyle::HexUpper);
+      size_t digits = std::min<size_t>(opts.digits, 64);
+      while (static_cast<size_t>(end - begin) < digits) {
+        *--begin = '0';
+      }
+      if (opts.prefix) {
+        *--begin = binary ? 'b' : 'x';
+        *--begin = '0';
+      }
+      return begin;
+    }
+    case IntegerStyle::Grouped: {
+      char digits[MaxIntegerSize];
+      char* first = WriteDecimal(digits + MaxIntegerSize, magnitude);
+      char* last = digits + MaxIntegerSize;
+      size_t count = 0;
+      while (last != first) {
+        if (count != 0 && count % 3 == 0) {
+          *--begin = ',';
+        }
+        *--begin = *--last;
+        ++count;
+      }
+      break;
+    }
+    default: {
+      begin = WriteDecimal(end, magnitude);
+      size_t digits = std::min<size_t>(opts.digits, 64);
+      while (static_cast<size_t>(end - begin) < digits) {
+        *--begin = '0';
+      }
+      break;
+    }
+  }
+
+  if (negative) {
+    *--begin = '-';
+  }
+  return begin;
+}
+
+// 按数值格式化的整数类型。只有 char 按字符输出；signed char 和
+// unsigned char（int8_t 和 uint8_t）与其他整数一样输出数值，
+// 两者的结果一致，例如 formatv("{0}", int8_t{-1}) 为 "-1"。
+template <typename T>
+struct IsFormattableInteger
+    : std::integral_constant<bool, std::is_integral_v<T> &&
+                                       !std::is_same_v<T, bool> &&
+                                       !std::is_same_v<T, char> &&
+                                       !std::is_same_v<T, wchar_t> &&
+                                       !std::is_same_v<T, char16_t> &&
+                                       !std::is_same_v<T, char32_t>> {};
+
+enum class FloatStyle : uint8_t {
+  Shortest,    // 空：能精确还原该值的最短表示
+  Fixed,       // "F" / "f"
+  Exponent,    // "e"
+  ExponentUp,  // "E"
+  Percent,     // "P" / "p"
+  General,     // "g"
+  GeneralUp,   // "G"
+};
+
+struct FloatOptions {
+  FloatStyle style = FloatStyle::Shortest;
+  // 未指定精度时为 std::nullopt。
+  std::optional<size_t> precision;
+};
+
+// 浮点数选项的语法为 [style][precision]，precision 为 0-99：
+//   F / f   定点小数，默认 2 位小数
+//   E / e   科学计数法，默认 6 位小数
+//   P / p   百分比，默认 2 位小数
+//   G / g   通用格式，未指定精度时为最短表示
+//   空      最短的可精确还原的表示
+constexpr auto ParseFloatOptions(std::string_view options) -> FloatOptions {
+  FloatOptions result;
+  if (options.empty()) {
+    return result;
+  }
+
+  switch (options.front()) {
+    case 'F':
+    case 'f':
+      result.style = FloatStyle::Fixed;
+      break;
+    case 'E':
+      result.style = FloatStyle::ExponentUp;
+      break;
+    case 'e':
+      result.style = FloatStyle::Exponent;
+      break;
+    case 'P':
+    case 'p':
+      result.style = FloatStyle::Percent;
+      break;
+    case 'G':
+      result.style = FloatStyle::GeneralUp;
+      break;
+    case 'g':
+      result.style = FloatStyle::General;
+      break;
+    default:
+      assert(false && "Invalid floating point format style!");
+      return result;
+  }
+  options.remove_prefix(1);
+
+  size_t precision = 0;
+  if (!options.empty()) {
+    if (FormatUtil::ConsumeInteger(options, 10, precision) ||
+        !options.empty()) {
+      assert(false && "Invalid floating point format precision!");
+    } else {
+      result.precision = std::min<size_t>(precision, 99);
+    }
+  }
+  return result;
+}
+
+// 定点格式下 double 的最大长度：符号、309 位整数、小数点、99 位小数和 `%`。
+inline constexpr size_t MaxFloatSize = 416;
+
+// 将浮点数格式化到 buffer 中，返回结果的末尾。
+template <typename T>
+auto FormatFloatTo(char (&buffer)[MaxFloatSize], T value,
+                   std::string_view options) -> char* {
+  FloatOptions opts = ParseFloatOptions(options);
+  char* first = buffer;
+  char* last = buffer + MaxFloatSize - 1;
+
+  std::to_chars_result result{};
+  switch (opts.style) {
+    case FloatStyle::Shortest:
+      result = std::to_chars(first, last, value);
+      break;
+    case FloatStyle::Fixed:
+      result = std::to_chars(first, last, value, std::chars_format::fixed,
+                             static_cast<int>(opts.precision.value_or(2)));
+      break;
+    case FloatStyle::Exponent:
+    case FloatStyle::ExponentUp:
+      result =
+          std::to_chars(first, last, value, std::chars_format::scientific,
+                        static_cast<int>(opts.precision.value_or(6)));
+      break;
+    case FloatStyle::Percent:
+      result = std::to_chars(first, last, value * 100, std::chars_format::fixed,
+                             static_cast<int>(opts.precision.value_or(2)));
+      break;
+    default:
+      result = opts.precision
+                   ? std::to_chars(first, last, value,
+                                   std::chars_format::general,
+                                   static_cast<int>(*opts.precision))
+                   : std::to_chars(first, last, value,
+                                   std::chars_format::general);
+      break;
+  }
+  assert(result.ec == std::errc() && "Floating point buffer too small!");
+
+  char* end = result.ptr;
+  if (opts.style == FloatStyle::ExponentUp ||
+      opts.style == FloatStyle::GeneralUp) {
+    for (char* p = first; p != end; ++p) {
+      if (*p >= 'a' && *p <= 'z') {
+        *p = static_cast<char>(*p - 'a' + 'A');
+      }
+    }
+  } else if (opts.style == FloatStyle::Percent) {
+    *end++ = '%';
+  }
+  return end;
+}
+
+// 以下函数由内置类型的 FormatProvider 和 FormatArg 共用。
+
+inline void FormatInteger(FormatSink& os, uint64_t magnitude, bool negative,
+                          unsigned bits, std::string_view options) {
+  char buffer[MaxIntegerSize];
+  char* begin = FormatIntegerTo(buffer, magnitude, negative, bits, options);
+  os.write(begin, buffer + MaxIntegerSize - begin);
+}
+
+// FormatIntegerTo 输出的长度，只数位数，不生成数字。
+inline auto IntegerSize(uint64_t magnitude, bool negative, unsigned bits,
+                        std::string_view options) -> size_t {
+  IntegerOptions opts = ParseIntegerOptions(options);
+  size_t min_digits = std::min<size_t>(opts.digits, 64);
+  switch (opts.style) {
+    case IntegerStyle::HexLower:
+    case IntegerStyle::HexUpper:
+    case IntegerStyle::Binary: {
+      unsigned shift = opts.style == IntegerStyle::Binary ? 1 : 4;
+      uint64_t value = PowerOfTwoValue(magnitude, negative, bits);
+      size_t digits = 1;
+      while ((value >>= shift) != 0) {
+        ++digits;
+      }
+      return std::max(digits, min_digits) + (opts.prefix ? 2 : 0);
+    }
+    case IntegerStyle::Grouped: {
+      size_t digits = DecimalDigits(magnitude);
+      return digits + (digits - 1) / 3 + (negative ? 1 : 0);
+    }
+    default:
+      return std::max(DecimalDigits(magnitude), min_digits) +
+             (negative ? 1 : 0);
+  }
+}
+
+template <typename T>
+constexpr auto IsNegative(T value) -> bool {
+  if constexpr (std::is_signed_v<T>) {
+    return value < 0;
+  } else {
+    return false;
+  }
+}
+
+// 整数的绝对值，以 uint64_t 表示以容纳最小的负数。
+template <typename T>
+constexpr auto IntegerMagnitude(T value) -> uint64_t {
+  auto magnitude = static_cast<uint64_t>(value);
+  return IsNegative(value) ? 0 - magnitude : magnitude;
+}
+
+template <typename T>
+void FormatFloat(FormatSink& os, T value, std::string_view options) {
+  char buffer[MaxFloatSize];
+  char* end = FormatFloatTo(buffer, value, options);
+  os.write(buffer, end - buffer);
+}
+
+// 字符串的选项为整数 N 时最多保留前 N 个字符。
+inline auto TruncateString(std::string_view str, std::string_view options)
+    -> std::string_view {
+  size_t n = str.size();
+  if (!options.empty() && FormatUtil::ConsumeInteger(options, 10, n)) {
+    n = str.size();
+  }
+  return str.substr(0, n);
+}
+
+}  // namespace Internal
+
+// float 和 double 的格式化，选项见 Internal::ParseFloatOptions。
+// 默认输出能精确还原该值的最短表示，全程使用栈上的缓冲区，不分配内存。
+// 格式化本身和计算长度的代价相当，因此不提供 formatted_size。
+template <typename T>
+struct FormatProvider<T, std::enable_if_t<std::is_same_v<T, float> ||
+                                          std::is_same_v<T, double>>> {
+  static void format(const T& value, FormatSink& os, std::string_view options) {
+    Internal::FormatFloat(os, value, options);
+  }
+};
+
+// 整数类型的格式化，选项见 Internal::ParseIntegerOptions。
+// 数字按两位一组查表生成，不经过 std::ostream。
+template <typename T>
+struct FormatProvider<
+    T, std::enable_if_t<Internal::IsFormattableInteger<T>::value>> {
+  static void format(const T& value, FormatSink& os, std::string_view options) {
+    Internal::FormatInteger(os, Internal::IntegerMagnitude(value),
+                            Internal::IsNegative(value), sizeof(T) * 8,
+                            options);
+  }
+
+  static auto formatted_size(const T& value, std::string_view options)
+      -> size_t {
+    return Internal::IntegerSize(Internal::IntegerMagnitude(value),
+                                 Internal::IsNegative(value), sizeof(T) * 8,
+                                 options);
+  }
+};
+
+// 字符串类型的格式化。
+// 选项为整数 N 时最多输出前 N 个字符，例如 `{0:3}`。
+template <typename T>
+struct FormatProvider<T, std::enable_if_t<Internal::IsStringLike<T>::value>> {
+  static void format(const T& value, FormatSink& os, std::string_view options) {
+    os.write(Internal::TruncateString(Internal::ToStringView(value), options));
+  }
+
+  static auto formatted_size(const T& value, std::string_view options)
+      -> size_t {
+    return Internal::TruncateString(Internal::ToStringView(value), options)
+        .size();
+  }
+};
+
+// 单个字符直接写入输出。
+template <>
+struct FormatProvider<char> {
+  static void format(const char& value, FormatSink& os,
+                     std::string_view /*options*/) {
+    os.put(value);
+  }
+
+  static auto formatted_size(const char& /*value*/,
+                             std::string_view /*options*/) -> size_t {
+    return 1;
+  }
+};
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_PROVIDERS_H
@@ -0,0 +1,141 @@
+#ifndef FORMATV_FORMAT_RANGE_H
+#define FORMATV_FORMAT_RANGE_H
+
+#include <cassert>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "FormatArgs.h"
+#include "FormatProviders.h"
+#include "FormatSink.h"
+#include "FormatUtil.h"
+#include "FormatVariadicDetails.h"
+
+namespace Formatv {
+
+namespace Internal {
+
+// 能用 adl_begin/adl_end 遍历的类型，包括标准容器和 ArrayRef。
+template <typename T, typename = void>
+struct IsRange : std::false_type {};
+
+template <typename T>
+struct IsRange<T, std::void_t<decltype(adl_begin(std::declval<const T&>())),
+                              decltype(adl_end(std::declval<const T&>()))>>
+    : std::true_type {};
+
+// 按范围格式化的类型。字符串、FormatAdapter 和自己提供了 operator<< 的
+// 容器保持原来的输出方式。内置数组的 operator<< 只是退化后的指针，
+// 同样按范围格式化（字符数组在此之前已作为字符串处理）。
+template <typename T>
+struct UsesRangeProvider
+    : std::integral_constant<bool, IsRange<T>::value &&
+                                       !IsStringLike<T>::value &&
+                                       !std::is_base_of_v<FormatAdapter, T> &&
+                                       (std::is_array_v<T> ||
+                                        !HasStreamOperator<T>::Value)> {};
+
+struct RangeOptions {
+  std::string_view separator = ", ";
+  std::string_view element;
+  std::string_view open;
+  std::string_view close;
+};
+
+// 取出 options 开头以 []、() 或 <> 定界的表达式。
+constexpr auto ConsumeDelimited(std::string_view& options,
+                                std::string_view& expr) -> bool {
+  if (options.empty()) {
+    return false;
+  }
+  char close = 0;
+  switch (options.front()) {
+    case '[':
+      close = ']';
+      break;
+    case '(':
+      close = ')';
+      break;
+    case '<':
+      close = '>';
+      break;
+    default:
+      return false;
+  }
+  size_t end = options.find(close, 1);
+  if (end == std::string_view::npos) {
+    return false;
+  }
+  expr = options.substr(1, end - 1);
+  options.remove_prefix(end + 1);
+  return true;
+}
+
+// 范围选项由任意顺序的子句组成，每个子句是一个字符加一个定界的表达式：
+//   $[sep]     元素之间的分隔符，默认为 ", "
+//   @[spec]    每个元素的格式选项
+//   ^[oc]      包围整个范围的括号，表达式的前一半为开头，后一半为结尾
+constexpr auto ParseRangeOptions(std::string_view options) -> RangeOptions {
+  RangeOptions result;
+  while (!options.empty()) {
+    char clause = options.front();
+    options.remove_prefix(1);
+    std::string_view expr;
+    if (!ConsumeDelimited(options, expr)) {
+      assert(false && "Invalid range format style!");
+      break;
+    }
+    switch (clause) {
+      case '$':
+        result.separator = expr;
+        break;
+      case '@':
+        result.element = expr;
+        break;
+      case '^':
+        result.open = expr.substr(0, expr.size() / 2);
+        result.close = expr.substr(expr.size() / 2);
+        break;
+      default:
+        assert(false && "Invalid range format style!");
+        return result;
+    }
+  }
+  return result;
+}
+
+}  // namespace Internal
+
+// 范围的格式化，选项见 Internal::ParseRangeOptions：
+//   formatv("{0}", std::vector<int>{1, 2, 3})               // "1, 2, 3"
+//   formatv("{0:$[ ]@[x-2]}", ArrayRef<uint8_t>(bytes))     // "0a ff 3c"
+//   formatv("{0:^<[]>@<$[;]>}", matrix)                     // "[1;2, 3;4]"
+// 表达式中不能出现它自己的结束定界符，需要时换用另一种定界符。
+// 每个元素通过各自的 FormatProvider 或 operator<< 直接写入 sink，
+// 不创建临时字符串；ArrayRef 只引用原数据，整个过程不复制元素。
+template <typename T>
+struct FormatProvider<T,
+                      std::enable_if_t<Internal::UsesRangeProvider<T>::value>> {
+  static void format(const T& range, FormatSink& os, std::string_view options) {
+    Internal::RangeOptions style = Internal::ParseRangeOptions(options);
+    if (!style.open.empty()) {
+      os.write(style.open);
+    }
+    auto it = Internal::adl_begin(range);
+    auto end = Internal::adl_end(range);
+    for (bool first = true; it != end; ++it, first = false) {
+      if (!first) {
+        os.write(style.separator);
+      }
+      Internal::FormatArg::Make(*it).format(os, style.element);
+    }
+    if (!style.close.empty()) {
+      os.write(style.close);
+    }
+  }
+};
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_RANGE_H
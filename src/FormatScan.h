@@ -0,0 +1,203 @@
+#ifndef FORMATV_FORMAT_SCAN_H
+#define FORMATV_FORMAT_SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FORMATV_SCAN_X86 1
+#else
+#define FORMATV_SCAN_X86 0
+#endif
+
+namespace Formatv {
+
+namespace Internal {
+
+// 格式字符串中所有 `{` 和 `}` 的位置，各自按升序排列。
+struct BracePositions {
+  std::vector<uint32_t> opens;
+  std::vector<uint32_t> closes;
+
+  void clear() {
+    opens.clear();
+    closes.clear();
+  }
+};
+
+// 逐字节扫描 [begin, end)，offset 是 begin 相对于格式字符串开头的位置。
+inline void ScanBracesScalar(const char* begin, const char* end,
+                             uint32_t offset, BracePositions& out) {
+  for (const char* p = begin; p != end; ++p, ++offset) {
+    if (*p == '{') {
+      out.opens.push_back(offset);
+    } else if (*p == '}') {
+      out.closes.push_back(offset);
+    }
+  }
+}
+
+// 把比较结果的位掩码展开为位置。
+inline void AppendMaskPositions(uint64_t mask, uint32_t offset,
+                                std::vector<uint32_t>& out) {
+  while (mask != 0) {
+    out.push_back(offset + static_cast<uint32_t>(__builtin_ctzll(mask)));
+    mask &= mask - 1;
+  }
+}
+
+#if FORMATV_SCAN_X86
+
+// 每次处理 64 字节：先把四次比较的结果合并测试，
+// 只有出现花括号的块才需要计算并展开位掩码。
+__attribute__((target("sse2"))) inline void ScanBracesSse2(
+    std::string_view fmt, BracePositions& out) {
+  const char* data = fmt.data();
+  size_t size = fmt.size();
+  const __m128i open = _mm_set1_epi8('{');
+  const __m128i close = _mm_set1_epi8('}');
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m128i o[4];
+    __m128i c[4];
+    for (int k = 0; k < 4; ++k) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16 * k));
+      o[k] = _mm_cmpeq_epi8(chunk, open);
+      c[k] = _mm_cmpeq_epi8(chunk, close);
+    }
+    __m128i any = _mm_or_si128(_mm_or_si128(_mm_or_si128(o[0], o[1]),
+                                            _mm_or_si128(o[2], o[3])),
+                               _mm_or_si128(_mm_or_si128(c[0], c[1]),
+                                            _mm_or_si128(c[2], c[3])));
+    if (_mm_movemask_epi8(any) == 0) {
+      continue;
+    }
+    uint64_t opens = 0;
+    uint64_t closes = 0;
+    for (int k = 0; k < 4; ++k) {
+      opens |= static_cast<uint64_t>(static_cast<uint16_t>(
+                   _mm_movemask_epi8(o[k])))
+               << (16 * k);
+      closes |= static_cast<uint64_t>(static_cast<uint16_t>(
+                    _mm_movemask_epi8(c[k])))
+                << (16 * k);
+    }
+    AppendMaskPositions(opens, static_cast<uint32_t>(i), out.opens);
+    AppendMaskPositions(closes, static_cast<uint32_t>(i), out.closes);
+  }
+  ScanBracesScalar(data + i, data + size, static_cast<uint32_t>(i), out);
+}
+
+// 与 SSE2 版本相同，每次比较两个 32 字节的块。
+__attribute__((target("avx2"))) inline void ScanBracesAvx2(
+    std::string_view fmt, BracePositions& out) {
+  const char* data = fmt.data();
+  size_t size = fmt.size();
+  const __m256i open = _mm256_set1_epi8('{');
+  const __m256i close = _mm256_set1_epi8('}');
+  size_t i = 0;
+  for (; i + 64 <= size; i += 64) {
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+    __m256i open_lo = _mm256_cmpeq_epi8(lo, open);
+    __m256i open_hi = _mm256_cmpeq_epi8(hi, open);
+    __m256i close_lo = _mm256_cmpeq_epi8(lo, close);
+    __m256i close_hi = _mm256_cmpeq_epi8(hi, close);
+    __m256i any = _mm256_or_si256(_mm256_or_si256(open_lo, open_hi),
+                                  _mm256_or_si256(close_lo, close_hi));
+    if (_mm256_testz_si256(any, any)) {
+      continue;
+    }
+    uint64_t opens =
+        static_cast<uint32_t>(_mm256_movemask_epi8(open_lo)) |
+        static_cast<uint64_t>(static_cast<uint32_t>(
+            _mm256_movemask_epi8(open_hi)))
+            << 32;
+    uint64_t closes =
+        static_cast<uint32_t>(_mm256_movemask_epi8(close_lo)) |
+        static_cast<uint64_t>(static_cast<uint32_t>(
+            _mm256_movemask_epi8(close_hi)))
+            << 32;
+    AppendMaskPositions(opens, static_cast<uint32_t>(i), out.opens);
+    AppendMaskPositions(closes, static_cast<uint32_t>(i), out.closes);
+  }
+  ScanBracesScalar(data + i, data + size, static_cast<uint32_t>(i), out);
+}
+
+#endif  // FORMATV_SCAN_X86
+
+// 扫描器的实现，可以在测试和基准中显式选择。
+enum class ScanMethod : uint8_t {
+  Scalar,
+  Sse2,
+  Avx2,
+};
+
+// 当前 CPU 支持的最快实现，只在第一次调用时检测。
+inline auto BestScanMethod() -> ScanMethod {
+#if FORMATV_SCAN_X86
+  static const ScanMethod method = [] {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return ScanMethod::Avx2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+      return ScanMethod::Sse2;
+    }
+    return ScanMethod::Scalar;
+  }();
+  return method;
+#else
+  return ScanMethod::Scalar;
+#endif
+}
+
+// 一次遍历找出 fmt 中所有花括号的位置。
+inline void ScanBraces(std::string_view fmt, BracePositions& out,
+                       ScanMethod method = BestScanMethod()) {
+  out.clear();
+  switch (method) {
+#if FORMATV_SCAN_X86
+    case ScanMethod::Avx2:
+      ScanBracesAvx2(fmt, out);
+      return;
+    case ScanMethod::Sse2:
+      ScanBracesSse2(fmt, out);
+      return;
+#endif
+    default:
+      ScanBracesScalar(fmt.data(), fmt.data() + fmt.size(), 0, out);
+      return;
+  }
+}
+
+// 在升序的位置表上单调前进的游标。
+class BraceCursor {
+ public:
+  explicit BraceCursor(const std::vector<uint32_t>& positions)
+      : positions_(positions) {}
+
+  // 返回不小于 from 的第一个位置，没有时返回 npos。
+  auto NextFrom(size_t from) -> size_t {
+    while (index_ < positions_.size() && positions_[index_] < from) {
+      ++index_;
+    }
+    return index_ < positions_.size() ? positions_[index_]
+                                      : std::string_view::npos;
+  }
+
+ private:
+  const std::vector<uint32_t>& positions_;
+  size_t index_ = 0;
+};
+
+}  // namespace Internal
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_SCAN_H
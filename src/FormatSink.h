@@ -0,0 +1,281 @@
+#ifndef FORMATV_FORMAT_SINK_H
+#define FORMATV_FORMAT_SINK_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+
+#include "FormatInstrument.h"
+
+namespace Formatv {
+
+// 格式化输出的目标。
+// 数据总是先写入 [begin_, end_) 这段缓冲区，热路径上的写入只是一次 memcpy；
+// 缓冲区写满时调用 Overflow()，由具体实现扩容、刷新或丢弃。
+// std::ostream 只是其中一种实现（StreamSink）。
+class FormatSink {
+ public:
+  FormatSink(const FormatSink&) = delete;
+  auto operator=(const FormatSink&) -> FormatSink& = delete;
+
+  virtual ~FormatSink() = default;
+
+  void write(const char* data, size_t size) {
+    while (size > static_cast<size_t>(end_ - cur_)) {
+      size_t n = end_ - cur_;
+      std::memcpy(cur_, data, n);
+      cur_ += n;
+      data += n;
+      size -= n;
+      Overflow(size);
+    }
+    std::memcpy(cur_, data, size);
+    cur_ += size;
+  }
+
+  void write(std::string_view str) { write(str.data(), str.size()); }
+
+  void put(char c) {
+    if (cur_ == end_) {
+      Overflow(1);
+    }
+    *cur_++ = c;
+  }
+
+  // 连续写入 count 个字符 c，用于对齐时的填充。
+  void fill(char c, size_t count) {
+    while (count > static_cast<size_t>(end_ - cur_)) {
+      size_t n = end_ - cur_;
+      std::memset(cur_, c, n);
+      cur_ += n;
+      count -= n;
+      Overflow(count);
+    }
+    std::memset(cur_, c, count);
+    cur_ += count;
+  }
+
+  // 到目前为止写入的总字节数，包括已经刷新或被截断的部分。
+  auto count() const -> size_t { return flushed_ + (cur_ - begin_); }
+
+  // 将缓冲的数据交给最终的输出目标。
+  virtual void Flush() {}
+
+ protected:
+  FormatSink() = default;
+
+  void SetBuffer(char* begin, char* cur, char* end) {
+    begin_ = begin;
+    cur_ = cur;
+    end_ = end;
+  }
+
+  // 缓冲区已满时调用，返回后缓冲区必须至少有一个字节可写。
+  // hint 是还需要写入的字节数，实现可以据此一次扩容到位。
+  virtual void Overflow(size_t hint) = 0;
+
+  char* begin_ = nullptr;
+  char* cur_ = nullptr;
+  char* end_ = nullptr;
+  // 已经移出缓冲区的字节数。
+  size_t flushed_ = 0;
+};
+
+// 追加写入字符串，直接以字符串本身作为缓冲区。
+// sink 存活期间 out 的末尾包含尚未使用的空间，Flush() 或析构后恢复为实际长度。
+// String 需要提供 data()、size()、capacity() 和 resize()，例如 SmallString。
+template <typename String>
+class BasicStringSink final : public FormatSink {
+ public:
+  explicit BasicStringSink(String& out) : out_(out), offset_(out.size()) {
+    out_.resize(std::max(out_.capacity(), offset_));
+    Rebind(0);
+  }
+
+  ~BasicStringSink() override { Flush(); }
+
+  void Flush() override {
+    size_t used = cur_ - begin_;
+    out_.resize(offset_ + used);
+    Rebind(used);
+  }
+
+ private:
+  void Overflow(size_t hint) override {
+    size_t used = cur_ - begin_;
+    size_t need = offset_ + used + std::max<size_t>(hint, 1);
+    size_t capacity = out_.capacity();
+    out_.resize(std::max({need, out_.size() * 2, MinCapacity}));
+    Internal::NoteGrowth(capacity, out_.capacity());
+    Rebind(used);
+  }
+
+  void Rebind(size_t used) {
+    char* begin = out_.data() + offset_;
+    SetBuffer(begin, begin + used, out_.data() + out_.size());
+  }
+
+  static constexpr size_t MinCapacity = 64;
+
+  String& out_;
+  size_t offset_;
+};
+
+using StringSink = BasicStringSink<std::string>;
+
+// 写入调用方提供的定长缓冲区，超出部分被丢弃但仍计入 count()。
+class FixedBufferSink final : public FormatSink {
+ public:
+  FixedBufferSink(char* buffer, size_t size) : capacity_(size) {
+    SetBuffer(buffer, buffer, buffer + size);
+  }
+
+  // 输出是否被截断。
+  auto truncated() const -> bool { return count() > capacity_; }
+
+  // 实际写入缓冲区的字节数。
+  auto written() const -> size_t { return std::min(count(), capacity_); }
+
+ private:
+  void Overflow(size_t /*hint*/) override {
+    flushed_ += cur_ - begin_;
+    SetBuffer(discard_, discard_, discard_ + sizeof(discard_));
+  }
+
+  size_t capacity_;
+  char discard_[64];
+};
+
+// 内容先写入 N 字节的内联缓冲区，超出时才转移到堆上。
+// 适合在栈上作为临时的格式化缓冲区。
+template <size_t N>
+class InlineBufferSink final : public FormatSink {
+ public:
+  InlineBufferSink() { SetBuffer(inline_, inline_, inline_ + N); }
+
+  auto data() const -> const char* { return begin_; }
+  auto size() const -> size_t { return cur_ - begin_; }
+  auto view() const -> std::string_view { return {begin_, size()}; }
+
+  void clear() { cur_ = begin_; }
+
+ private:
+  void Overflow(size_t hint) override {
+    size_t used = cur_ - begin_;
+    size_t capacity = std::max<size_t>(2 * (end_ - begin_), used + hint);
+    std::unique_ptr<char[]> heap(new char[capacity]);
+    std::memcpy(heap.get(), begin_, used);
+    heap_ = std::move(heap);
+    SetBuffer(heap_.get(), heap_.get() + used, heap_.get() + capacity);
+  }
+
+  char inline_[N];
+  std::unique_ptr<char[]> heap_;
+};
+
+// 只统计写入的字节数而不保存内容，用于计算输出长度。
+class CountingSink final : public FormatSink {
+ public:
+  CountingSink() { SetBuffer(scratch_, scratch_, scratch_ + sizeof(scratch_)); }
+
+ private:
+  void Overflow(size_t /*hint*/) override {
+    flushed_ += cur_ - begin_;
+    cur_ = begin_;
+  }
+
+  char scratch_[128];
+};
+
+// 写入任意输出迭代器，先在栈上缓冲再批量拷贝。
+// limit 限制最多写入的字符数，超出部分只计数。
+template <typename OutputIt>
+class IteratorSink final : public FormatSink {
+ public:
+  explicit IteratorSink(OutputIt out, size_t limit = static_cast<size_t>(-1))
+      : out_(out), limit_(limit) {
+    SetBuffer(buffer_, buffer_, buffer_ + sizeof(buffer_));
+  }
+
+  void Flush() override {
+    size_t n = cur_ - begin_;
+    size_t copied = std::min(n, limit_);
+    out_ = std::copy_n(buffer_, copied, out_);
+    limit_ -= copied;
+    flushed_ += n;
+    cur_ = begin_;
+  }
+
+  // 刷新缓冲区并返回指向输出末尾的迭代器。
+  auto out() -> OutputIt {
+    Flush();
+    return out_;
+  }
+
+ private:
+  void Overflow(size_t /*hint*/) override { Flush(); }
+
+  OutputIt out_;
+  size_t limit_;
+  char buffer_[256];
+};
+
+// 写入 std::ostream，析构时刷新。
+class StreamSink final : public FormatSink {
+ public:
+  explicit StreamSink(std::ostream& os) : os_(os) {
+    SetBuffer(buffer_, buffer_, buffer_ + sizeof(buffer_));
+  }
+
+  ~StreamSink() override { Flush(); }
+
+  void Flush() override {
+    size_t n = cur_ - begin_;
+    os_.write(buffer_, static_cast<std::streamsize>(n));
+    flushed_ += n;
+    cur_ = begin_;
+  }
+
+ private:
+  void Overflow(size_t /*hint*/) override { Flush(); }
+
+  std::ostream& os_;
+  char buffer_[512];
+};
+
+namespace Internal {
+
+// 把 FormatSink 包装为 std::streambuf，
+// 供只提供了 operator<<(std::ostream&) 的类型使用。
+class SinkStreamBuf : public std::streambuf {
+ public:
+  explicit SinkStreamBuf(FormatSink& sink) : sink_(sink) {}
+
+ protected:
+  auto overflow(int_type c) -> int_type override {
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      sink_.put(traits_type::to_char_type(c));
+    }
+    return traits_type::not_eof(c);
+  }
+
+  auto xsputn(const char_type* s, std::streamsize n)
+      -> std::streamsize override {
+    sink_.write(s, static_cast<size_t>(n));
+    return n;
+  }
+
+ private:
+  FormatSink& sink_;
+};
+
+}  // namespace Internal
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_SINK_H
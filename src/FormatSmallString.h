@@ -0,0 +1,197 @@
+#ifndef FORMATV_FORMAT_SMALL_STRING_H
+#define FORMATV_FORMAT_SMALL_STRING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "FormatInstrument.h"
+#include "FormatProviders.h"
+#include "FormatUtil.h"
+
+namespace Formatv {
+
+// 带 N 字节内联缓冲区的字符串，内容不超过 N 时不分配内存，超出时转移到堆上。
+// 适合作为短消息的格式化结果：
+//   auto msg = formatv("{0} took {1} us", name, elapsed).to<SmallString<128>>();
+// 可以隐式转换为 std::string_view 和 ArrayRef<char>，传递时不需要复制，
+// 也可以直接作为 formatv 的字符串参数。内容不以 '\0' 结尾。
+template <size_t N>
+class SmallString {
+ public:
+  static_assert(N > 0, "SmallString needs a non-empty inline buffer!");
+
+  using value_type = char;
+  using iterator = char*;
+  using const_iterator = const char*;
+
+  SmallString() = default;
+
+  SmallString(std::string_view str) { append(str); }
+
+  SmallString(const SmallString& rhs) { append(rhs.view()); }
+
+  SmallString(SmallString&& rhs) noexcept { MoveFrom(rhs); }
+
+  ~SmallString() { Release(); }
+
+  auto operator=(const SmallString& rhs) -> SmallString& {
+    if (this != &rhs) {
+      assign(rhs.view());
+    }
+    return *this;
+  }
+
+  auto operator=(SmallString&& rhs) noexcept -> SmallString& {
+    if (this != &rhs) {
+      Release();
+      MoveFrom(rhs);
+    }
+    return *this;
+  }
+
+  auto operator=(std::string_view str) -> SmallString& {
+    assign(str);
+    return *this;
+  }
+
+  auto data() -> char* { return data_; }
+  auto data() const -> const char* { return data_; }
+  auto size() const -> size_t { return size_; }
+  auto capacity() const -> size_t { return capacity_; }
+  auto empty() const -> bool { return size_ == 0; }
+
+  // 内容是否仍在内联缓冲区中。
+  auto is_inline() const -> bool { return data_ == inline_; }
+
+  auto begin() -> iterator { return data_; }
+  auto end() -> iterator { return data_ + size_; }
+  auto begin() const -> const_iterator { return data_; }
+  auto end() const -> const_iterator { return data_ + size_; }
+
+  auto operator[](size_t i) -> char& { return data_[i]; }
+  auto operator[](size_t i) const -> char { return data_[i]; }
+
+  auto view() const -> std::string_view { return {data_, size_}; }
+  operator std::string_view() const { return view(); }
+
+  auto str() const -> std::string { return std::string(data_, size_); }
+
+  void reserve(size_t capacity) {
+    if (capacity > capacity_) {
+      Grow(capacity);
+    }
+  }
+
+  // 与 std::string::resize 相同，新增的字符为 c。
+  void resize(size_t size, char c = '\0') {
+    reserve(size);
+    if (size > size_) {
+      std::memset(data_ + size_, c, size - size_);
+    }
+    size_ = size;
+  }
+
+  void clear() { size_ = 0; }
+
+  void assign(std::string_view str) {
+    clear();
+    append(str);
+  }
+
+  void append(const char* data, size_t size) {
+    if (size_ + size > capacity_) {
+      Grow(std::max(size_ + size, capacity_ * 2));
+    }
+    std::memcpy(data_ + size_, data, size);
+    size_ += size;
+  }
+
+  void append(std::string_view str) { append(str.data(), str.size()); }
+
+  void push_back(char c) {
+    if (size_ == capacity_) {
+      Grow(capacity_ * 2);
+    }
+    data_[size_++] = c;
+  }
+
+  auto operator+=(std::string_view str) -> SmallString& {
+    append(str);
+    return *this;
+  }
+
+  auto operator+=(char c) -> SmallString& {
+    push_back(c);
+    return *this;
+  }
+
+ private:
+  void Grow(size_t capacity) {
+    char* heap = new char[capacity];
+    Internal::NoteAllocation(capacity);
+    std::memcpy(heap, data_, size_);
+    Release();
+    data_ = heap;
+    capacity_ = capacity;
+  }
+
+  void Release() {
+    if (!is_inline()) {
+      delete[] data_;
+    }
+  }
+
+  // 堆上的内容直接接管，内联的内容复制过来。rhs 被置为空。
+  void MoveFrom(SmallString& rhs) {
+    if (rhs.is_inline()) {
+      data_ = inline_;
+      capacity_ = N;
+      std::memcpy(inline_, rhs.inline_, rhs.size_);
+    } else {
+      data_ = rhs.data_;
+      capacity_ = rhs.capacity_;
+      rhs.data_ = rhs.inline_;
+      rhs.capacity_ = N;
+    }
+    size_ = rhs.size_;
+    rhs.size_ = 0;
+  }
+
+  char* data_ = inline_;
+  size_t size_ = 0;
+  size_t capacity_ = N;
+  char inline_[N];
+};
+
+template <size_t N>
+auto operator==(const SmallString<N>& lhs, std::string_view rhs) -> bool {
+  return lhs.view() == rhs;
+}
+
+template <size_t N>
+auto operator!=(const SmallString<N>& lhs, std::string_view rhs) -> bool {
+  return lhs.view() != rhs;
+}
+
+template <size_t N>
+auto operator<<(std::ostream& os, const SmallString<N>& str) -> std::ostream& {
+  return os.write(str.data(), static_cast<std::streamsize>(str.size()));
+}
+
+namespace Internal {
+
+// 作为 formatv 的参数时按字符串处理，与 std::string 的选项相同。
+template <size_t N>
+struct IsStringLike<SmallString<N>> : std::true_type {};
+
+}  // namespace Internal
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_SMALL_STRING_H
@@ -0,0 +1,356 @@
+#ifndef FORMATV_FORMAT_STREAM_H
+#define FORMATV_FORMAT_STREAM_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include "FormatInstrument.h"
+#include "FormatSink.h"
+
+namespace Formatv {
+
+namespace Internal {
+
+// 用 writev 写出全部 iov，处理部分写入和 EINTR。成功时返回 0，否则返回 errno。
+// iov 的内容会被修改。
+inline auto WriteAll(int fd, iovec* iov, int count) -> int {
+  while (count > 0) {
+    ssize_t n = ::writev(fd, iov, count);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return errno;
+    }
+    auto written = static_cast<size_t>(n);
+    while (count > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      ++iov;
+      --count;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+      iov->iov_len -= written;
+    }
+  }
+  return 0;
+}
+
+inline auto WriteAll(int fd, const char* data, size_t size) -> int {
+  iovec iov{const_cast<char*>(data), size};
+  return WriteAll(fd, &iov, 1);
+}
+
+}  // namespace Internal
+
+// ChunkedSink 的输出目标：每次交给它一整块数据。
+// Write 返回前必须写完（或放弃）全部数据，阻塞的写入即形成背压。
+class ChunkWriter {
+ public:
+  virtual ~ChunkWriter() = default;
+
+  // 写出 [data, data + size)，失败时返回 false，之后的输出将被丢弃。
+  virtual auto Write(const char* data, size_t size) -> bool = 0;
+};
+
+// 写入文件描述符，处理部分写入和 EINTR。不负责关闭 fd。
+class FdWriter final : public ChunkWriter {
+ public:
+  explicit FdWriter(int fd) : fd_(fd) {}
+
+  auto Write(const char* data, size_t size) -> bool override {
+    error_ = Internal::WriteAll(fd_, data, size);
+    return error_ == 0;
+  }
+
+  // 最近一次失败的 errno，没有失败时为 0。
+  auto error() const -> int { return error_; }
+
+ private:
+  int fd_;
+  int error_ = 0;
+};
+
+// 写入 FILE*。数据仍会经过 FILE 自己的缓冲区，需要时由调用方 fflush。
+class FileWriter final : public ChunkWriter {
+ public:
+  explicit FileWriter(std::FILE* file) : file_(file) {}
+
+  auto Write(const char* data, size_t size) -> bool override {
+    return std::fwrite(data, 1, size, file_) == size;
+  }
+
+ private:
+  std::FILE* file_;
+};
+
+// 把每一块交给回调 f(std::string_view)。f 返回 bool 时以其作为写入结果，
+// 返回 void 时视为总是成功：
+//   CallbackWriter writer([&](std::string_view chunk) { socket.send(chunk); });
+template <typename F>
+class CallbackWriter final : public ChunkWriter {
+ public:
+  explicit CallbackWriter(F f) : f_(std::move(f)) {}
+
+  auto Write(const char* data, size_t size) -> bool override {
+    std::string_view chunk(data, size);
+    if constexpr (std::is_void_v<std::invoke_result_t<F&, std::string_view>>) {
+      f_(chunk);
+      return true;
+    } else {
+      return static_cast<bool>(f_(chunk));
+    }
+  }
+
+ private:
+  F f_;
+};
+
+// 以定长的块为单位输出：内容写入一个 chunk_size 字节的缓冲区，
+// 写满时整块交给 ChunkWriter，然后从头复用同一个缓冲区。
+// 无论总输出有多大，内存占用都只有这一块，适合导出 GB 级的数据。
+// 右对齐和居中的字段在长度未知时先在 ScratchArena 中缓冲，最多
+// ScratchArena::MaxRetained 字节，更宽的字段先计数再直接写入 sink：
+//   FdWriter writer(fd);
+//   ChunkedSink sink(writer);
+//   format_batch(sink, tmpl, rows, project);
+//   formatv("{0:$[\n]}", huge_vector).format(sink);
+// 写入失败后不再调用 writer，其余输出被丢弃但仍计入 count()。
+// 析构时刷新剩余的内容；需要检查结果时先调用 Flush() 再查看 failed()。
+class ChunkedSink final : public FormatSink {
+ public:
+  static constexpr size_t DefaultChunkSize = 64 * 1024;
+
+  explicit ChunkedSink(ChunkWriter& writer,
+                       size_t chunk_size = DefaultChunkSize)
+      : writer_(writer),
+        chunk_size_(std::max<size_t>(chunk_size, 1)),
+        buffer_(new char[chunk_size_]) {
+    Internal::NoteAllocation(chunk_size_);
+    SetBuffer(buffer_.get(), buffer_.get(), buffer_.get() + chunk_size_);
+  }
+
+  ~ChunkedSink() override { Flush(); }
+
+  void Flush() override {
+    size_t n = cur_ - begin_;
+    if (n != 0 && !failed_) {
+      failed_ = !writer_.Write(begin_, n);
+      ++chunks_;
+    }
+    flushed_ += n;
+    cur_ = begin_;
+  }
+
+  auto chunk_size() const -> size_t { return chunk_size_; }
+
+  // 交给 writer 的块数。
+  auto chunks() const -> size_t { return chunks_; }
+
+  // writer 是否报告过写入失败。
+  auto failed() const -> bool { return failed_; }
+
+ private:
+  void Overflow(size_t /*hint*/) override { Flush(); }
+
+  ChunkWriter& writer_;
+  size_t chunk_size_;
+  std::unique_ptr<char[]> buffer_;
+  size_t chunks_ = 0;
+  bool failed_ = false;
+};
+
+// 直接写入文件描述符的 sink，不经过 std::ostream 和 libc 的缓冲。
+// 输出先积累在一个按页对齐的大缓冲区中，写满或 Flush() 时才调用一次
+// write，多次格式化调用的输出合并为一次系统调用：
+//   FdSink sink(fd);
+//   for (const auto& r : records) {
+//     formatv("{0,-12}|{1,10:N}\n", r.name, r.count).format(sink);
+//   }
+// 很大的现成数据（例如文件内容）可以用 write_direct 与缓冲区一起通过
+// writev 写出，不复制到缓冲区中。
+// 写入失败后不再写 fd，其余输出被丢弃但仍计入 count()。析构时刷新。
+class FdSink final : public FormatSink {
+ public:
+  static constexpr size_t DefaultBufferSize = 1 << 20;
+  static constexpr size_t Alignment = 4096;
+
+  explicit FdSink(int fd, size_t buffer_size = DefaultBufferSize)
+      : fd_(fd),
+        size_((std::max(buffer_size, Alignment) + Alignment - 1) /
+              Alignment * Alignment),
+        buffer_(static_cast<char*>(
+            ::operator new[](size_, std::align_val_t(Alignment)))) {
+    Internal::NoteAllocation(size_);
+    SetBuffer(buffer_.get(), buffer_.get(), buffer_.get() + size_);
+  }
+
+  ~FdSink() override { Flush(); }
+
+  void Flush() override {
+    size_t n = cur_ - begin_;
+    if (n != 0 && error_ == 0) {
+      error_ = Internal::WriteAll(fd_, begin_, n);
+      ++writes_;
+    }
+    flushed_ += n;
+    cur_ = begin_;
+  }
+
+  // 写出 data。超过缓冲区一半的数据不复制，与已缓冲的内容一起交给 writev。
+  // data 只需在调用期间有效。
+  void write_direct(std::string_view data) {
+    if (data.size() < size_ / 2) {
+      write(data);
+      return;
+    }
+    size_t n = cur_ - begin_;
+    if (error_ == 0) {
+      iovec iov[2] = {{begin_, n},
+                      {const_cast<char*>(data.data()), data.size()}};
+      error_ = Internal::WriteAll(fd_, iov, 2);
+      ++writes_;
+    }
+    flushed_ += n + data.size();
+    cur_ = begin_;
+  }
+
+  // 调用 write/writev 的次数。
+  auto writes() const -> size_t { return writes_; }
+
+  auto failed() const -> bool { return error_ != 0; }
+
+  // 写入失败时的 errno，没有失败时为 0。
+  auto error() const -> int { return error_; }
+
+ private:
+  struct AlignedDelete {
+    void operator()(char* p) const {
+      ::operator delete[](p, std::align_val_t(Alignment));
+    }
+  };
+
+  void Overflow(size_t /*hint*/) override { Flush(); }
+
+  int fd_;
+  size_t size_;
+  std::unique_ptr<char, AlignedDelete> buffer_;
+  size_t writes_ = 0;
+  int error_ = 0;
+};
+
+// 直接格式化到文件的内存映射中，省去从用户缓冲区到内核的一次复制。
+// 文件按 extent 字节为单位增长：当前窗口写满时解除映射，
+// 把文件扩展一个 extent 并映射新的窗口，因此占用的地址空间只有一个窗口，
+// 与文件总大小无关。
+//   int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+//   MmapSink sink(fd);
+//   format_batch(sink, tmpl, rows, project);
+//   sink.Close();  // 截断到实际长度
+// 从文件开头写入；fd 必须以读写方式打开，由调用方关闭。
+// 在 Close() 之前文件末尾含有未使用的 extent 空间，析构时自动 Close()。
+// 每个 extent 在映射前预先分配，磁盘空间不足时报告 ENOSPC 而不是 SIGBUS。
+// 映射或分配失败后其余输出被丢弃但仍计入 count()，文件保留已写入的部分。
+class MmapSink final : public FormatSink {
+ public:
+  static constexpr size_t DefaultExtent = 64 << 20;
+
+  explicit MmapSink(int fd, size_t extent = DefaultExtent)
+      : fd_(fd), extent_(RoundToPages(extent)) {
+    SetBuffer(discard_, discard_, discard_ + sizeof(discard_));
+    MapWindow();
+  }
+
+  ~MmapSink() override { Close(); }
+
+  // 解除映射并把文件截断到实际写入的长度。之后的输出被丢弃。
+  void Close() {
+    if (closed_) {
+      return;
+    }
+    closed_ = true;
+    Unmap();
+    if (::ftruncate(fd_, static_cast<off_t>(written_)) != 0 && error_ == 0) {
+      error_ = errno;
+    }
+  }
+
+  auto failed() const -> bool { return error_ != 0; }
+
+  // 映射或扩展文件失败时的 errno，没有失败时为 0。
+  auto error() const -> int { return error_; }
+
+ private:
+  static auto RoundToPages(size_t size) -> size_t {
+    auto page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    return (std::max(size, page) + page - 1) / page * page;
+  }
+
+  void Overflow(size_t /*hint*/) override {
+    if (map_ == nullptr) {
+      // 已关闭或出错：只计数。
+      flushed_ += cur_ - begin_;
+      cur_ = begin_;
+      return;
+    }
+    Unmap();
+    MapWindow();
+  }
+
+  // 在文件偏移 written_ 处映射一个新的窗口。先为窗口分配磁盘空间：
+  // 只用 ftruncate 扩展出的空洞在磁盘写满时会让写入映射的指令触发 SIGBUS，
+  // 预先分配则在这里以 ENOSPC 失败。
+  void MapWindow() {
+    int result = ::posix_fallocate(fd_, static_cast<off_t>(written_),
+                                   static_cast<off_t>(extent_));
+    if (result != 0) {
+      error_ = result;
+      return;
+    }
+    void* map = ::mmap(nullptr, extent_, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       fd_, static_cast<off_t>(written_));
+    if (map == MAP_FAILED) {
+      error_ = errno;
+      return;
+    }
+    map_ = static_cast<char*>(map);
+    SetBuffer(map_, map_, map_ + extent_);
+  }
+
+  // 把当前窗口中的内容计入已写入的长度，解除映射并改为写入丢弃缓冲区。
+  void Unmap() {
+    if (map_ == nullptr) {
+      return;
+    }
+    flushed_ += cur_ - begin_;
+    written_ += cur_ - begin_;
+    ::munmap(map_, extent_);
+    map_ = nullptr;
+    SetBuffer(discard_, discard_, discard_ + sizeof(discard_));
+  }
+
+  int fd_;
+  size_t extent_;
+  char* map_ = nullptr;
+  // 已写入文件的字节数，也是下一个窗口在文件中的偏移。
+  size_t written_ = 0;
+  int error_ = 0;
+  bool closed_ = false;
+  char discard_[64];
+};
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_STREAM_H
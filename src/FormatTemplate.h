@@ -0,0 +1,120 @@
+#ifndef FORMATV_FORMAT_TEMPLATE_H
+#define FORMATV_FORMAT_TEMPLATE_H
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "FormatArgs.h"
+#include "FormatSink.h"
+#include "FormatUtil.h"
+#include "FormatVariadic.h"
+
+namespace Formatv {
+
+// 预编译的格式模板：格式字符串只解析一次，之后可以绑定任意多组参数。
+//   FormatTemplate row("{0,-12}|{1,8:N}|{2}\n");
+//   for (const auto& r : rows) row(sink, r.name, r.count, r.note);
+// 构造完成后内容不再改变，所有成员函数都是 const 的，
+// 因此同一个模板（及其副本）可以被多个线程同时使用。
+class FormatTemplate {
+ public:
+  explicit FormatTemplate(std::string_view fmt)
+      : compiled_(Compile(fmt)) {}
+
+  // 使用给定的参数格式化并写入 sink。
+  template <typename... Ts>
+  void operator()(FormatSink& os, const Ts&... vals) const {
+    format(os, make_format_args(vals...));
+  }
+
+  void format(FormatSink& os, ArrayRef<Internal::FormatArg> args) const {
+    for (const auto& r : compiled_->items) {
+      FormatvObjectBase::FormatItem(os, r, args);
+    }
+  }
+
+  // 绑定一组参数，得到支持 str()/format_to()/format_to_n() 的格式化对象。
+  // 返回的对象引用模板和 args，不能比它们活得更久。
+  auto bind(ArrayRef<Internal::FormatArg> args) const -> FormatvRefObject<0> {
+    return FormatvRefObject<0>(compiled_->items, args);
+  }
+
+  template <typename... Ts>
+  auto str(const Ts&... vals) const -> std::string {
+    return bind(make_format_args(vals...)).str();
+  }
+
+  // 替换项的个数，以及模板要求的最少参数个数（最大索引加一）。
+  auto field_count() const -> size_t { return compiled_->field_count; }
+  auto arg_count() const -> size_t { return compiled_->arg_count; }
+
+  // 所有字面量的总长度，即输出长度的下限。
+  auto literal_size() const -> size_t { return compiled_->literals.size(); }
+
+  auto items() const -> ArrayRef<ReplacementItem> { return compiled_->items; }
+
+ private:
+  struct Compiled {
+    // 原始格式字符串，替换项的 spec 和 options 指向它。
+    std::string fmt;
+    // 相邻字面量（包括 {{ 转义）合并后的文本，字面量项指向它。
+    std::string literals;
+    std::vector<ReplacementItem> items;
+    size_t field_count = 0;
+    size_t arg_count = 0;
+  };
+
+  static auto Compile(std::string_view fmt)
+      -> std::shared_ptr<const Compiled> {
+    auto compiled = std::make_shared<Compiled>();
+    compiled->fmt = std::string(fmt);
+    std::vector<ReplacementItem> parsed =
+        FormatvObjectBase::ParseFormatString(compiled->fmt);
+
+    // 先确定合并后字面量的位置，literals 不再改变后才能生成视图。
+    struct Segment {
+      size_t offset;
+      size_t size;
+    };
+    std::vector<Segment> segments;
+    std::vector<ReplacementItem> fields;
+    bool in_literal = false;
+    for (const auto& item : parsed) {
+      if (item.type == ReplacementType::Literal) {
+        if (!in_literal) {
+          segments.push_back({compiled->literals.size(), 0});
+          fields.emplace_back(std::string_view());
+          in_literal = true;
+        }
+        compiled->literals.append(item.spec.data(), item.spec.size());
+        segments.back().size += item.spec.size();
+      } else if (item.type == ReplacementType::Format) {
+        fields.push_back(item);
+        in_literal = false;
+        ++compiled->field_count;
+        compiled->arg_count = std::max(compiled->arg_count, item.index + 1);
+      }
+    }
+
+    auto segment = segments.begin();
+    compiled->items.reserve(fields.size());
+    for (auto& item : fields) {
+      if (item.type == ReplacementType::Literal) {
+        item.spec = std::string_view(compiled->literals).substr(
+            segment->offset, segment->size);
+        ++segment;
+      }
+      compiled->items.push_back(item);
+    }
+    return compiled;
+  }
+
+  std::shared_ptr<const Compiled> compiled_;
+};
+
+}  // namespace Formatv
+
+#endif  // FORMATV_FORMAT_TEMPLATE_H
@@ -1,24 +1,26 @@
 #ifndef FORMATV_FORMAT_UTIL_H
 #define FORMATV_FORMAT_UTIL_H
 
+#include <algorithm>
 #include <array>
 #include <cassert>
 #include <cctype>
-#include <functional>
 #include <initializer_list>
 #include <iterator>
 #include <limits>
 #include <optional>
+#include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
-#include "FormatAlign.h"
+#include "FormatVariadicDetails.h"
 
 namespace Formatv {
 
 class FormatUtil {
  public:
-  static auto TranslateLocChar(char c) -> std::optional<AlignStyle> {
+  static constexpr auto TranslateLocChar(char c) -> std::optional<AlignStyle> {
     switch (c) {
       case '-':
         return AlignStyle::Left;
@@ -31,38 +33,45 @@ class FormatUtil {
     }
   }
 
-  static auto ltrim(const std::string& str, const std::string& chars)
-      -> std::string {
+  // 以下基于 std::string_view 的接口只返回原字符串的视图，不分配内存。
+  // 它们都是 constexpr 的，可以在编译期解析格式字符串。
+  static constexpr auto ltrim(std::string_view str, std::string_view chars)
+      -> std::string_view {
     const auto str_begin = str.find_first_not_of(chars);
-    return (str_begin == std::string::npos) ? "" : str.substr(str_begin);
+    return (str_begin == std::string_view::npos) ? std::string_view()
+                                                 : str.substr(str_begin);
   }
 
-  static auto rtrim(const std::string& str, const std::string& chars)
-      -> std::string {
+  static constexpr auto rtrim(std::string_view str, std::string_view chars)
+      -> std::string_view {
     const auto str_end = str.find_last_not_of(chars);
-    return (str_end == std::string::npos) ? "" : str.substr(0, str_end + 1);
+    return (str_end == std::string_view::npos) ? std::string_view()
+                                               : str.substr(0, str_end + 1);
   }
 
-  static auto trim(const std::string& str,
-                   const std::string& chars = " \t\n\v\f\r") -> std::string {
+  static constexpr auto trim(std::string_view str,
+                             std::string_view chars = " \t\n\v\f\r")
+      -> std::string_view {
     return rtrim(ltrim(str, chars), chars);
   }
 
-  static auto GetAutoSenseRadix(std::string& str) -> unsigned {
+  static constexpr auto GetAutoSenseRadix(std::string_view& str) -> unsigned {
     if (str.empty()) {
       return 10;
     }
 
-    if (str[0] == '0' && str.size() > 1 && std::isdigit(str[1])) {
-      str = str.substr(1);
+    if (str[0] == '0' && str.size() > 1 && str[1] >= '0' && str[1] <= '9') {
+      str.remove_prefix(1);
       return 8;
     }
 
     return 10;
   }
 
-  static auto consumeUnsignedInteger(std::string& str, unsigned radix,
-                                     unsigned long long& result) -> bool {
+  static constexpr auto consumeUnsignedInteger(std::string_view& str,
+                                               unsigned radix,
+                                               unsigned long long& result)
+      -> bool {
     if (radix == 0) {
       radix = GetAutoSenseRadix(str);
     }
@@ -71,10 +80,10 @@ class FormatUtil {
       return true;
     }
 
-    std::string str2 = str;
+    std::string_view str2 = str;
     result = 0;
     while (!str2.empty()) {
-      unsigned char_val;
+      unsigned char_val = 0;
       if (str2[0] >= '0' && str2[0] <= '9') {
         char_val = str2[0] - '0';
       } else if (str2[0] >= 'a' && str2[0] <= 'z') {
@@ -96,7 +105,7 @@ class FormatUtil {
         return true;
       }
 
-      str2 = str2.substr(1);
+      str2.remove_prefix(1);
     }
 
     if (str.size() == str2.size()) {
@@ -107,9 +116,10 @@ class FormatUtil {
     return false;
   }
 
-  static auto consumeSignedInteger(std::string& str, unsigned radix,
-                                   long long& result) -> bool {
-    unsigned long long ull_val;
+  static constexpr auto consumeSignedInteger(std::string_view& str,
+                                             unsigned radix, long long& result)
+      -> bool {
+    unsigned long long ull_val = 0;
 
     if (str.empty() || str.front() != '-') {
       if (consumeUnsignedInteger(str, radix, ull_val) ||
@@ -120,7 +130,7 @@ class FormatUtil {
       return false;
     }
 
-    std::string str2 = drop_front(str, 1);
+    std::string_view str2 = drop_front(str, 1);
     if (consumeUnsignedInteger(str2, radix, ull_val) ||
         static_cast<long long>(-ull_val) > 0) {
       return true;
@@ -132,17 +142,17 @@ class FormatUtil {
   }
 
   template <typename T>
-  static auto ConsumeInteger(std::string& str, unsigned radix, T& result)
-      -> bool {
+  static constexpr auto ConsumeInteger(std::string_view& str, unsigned radix,
+                                       T& result) -> bool {
     if constexpr (std::numeric_limits<T>::is_signed) {
-      long long ll_val;
+      long long ll_val = 0;
       if (consumeSignedInteger(str, radix, ll_val) ||
           static_cast<long long>(static_cast<T>(ll_val)) != ll_val) {
         return true;
       }
       result = ll_val;
     } else {
-      unsigned long long ull_val;
+      unsigned long long ull_val = 0;
       if (consumeUnsignedInteger(str, radix, ull_val) ||
           static_cast<unsigned long long>(static_cast<T>(ull_val)) != ull_val) {
         return true;
@@ -152,46 +162,132 @@ class FormatUtil {
     return false;
   }
 
-  static auto take_while(const std::string& str, std::function<bool(char)> f)
-      -> std::string {
-    auto end = std::find_if_not(str.begin(), str.end(), f);
-    return std::string(str.begin(), end);
+  template <typename PredicateT>
+  static constexpr auto take_while(std::string_view str, PredicateT f)
+      -> std::string_view {
+    size_t end = 0;
+    while (end < str.size() && f(str[end])) {
+      ++end;
+    }
+    return str.substr(0, end);
   }
 
-  static auto take_front(const std::string& str, std::size_t n = 1)
-      -> std::string {
-    return str.substr(0, n);
+  static constexpr auto take_front(std::string_view str, std::size_t n = 1)
+      -> std::string_view {
+    return str.substr(0, std::min(n, str.size()));
   }
 
-  static auto drop_front(const std::string& str, std::size_t n = 1)
-      -> std::string {
-    return str.substr(n);
+  static constexpr auto drop_front(std::string_view str, std::size_t n = 1)
+      -> std::string_view {
+    return str.substr(std::min(n, str.size()));
   }
 
-  static auto slice(const std::string& str, std::size_t start, std::size_t end)
-      -> std::string {
+  static constexpr auto slice(std::string_view str, std::size_t start,
+                              std::size_t end) -> std::string_view {
     const std::size_t length = str.length();
     start = std::min(start, length);
     end = std::clamp(end, start, length);
     return str.substr(start, end - start);
   }
 
-  static auto find(const std::string& str, char c, size_t from = 0) -> size_t {
-    return std::string_view(str).find(c, from);
+  static constexpr auto find(std::string_view str, char c, size_t from = 0)
+      -> size_t {
+    return str.find(c, from);
   }
 
-  static auto find_first_of(const std::string& str, char c, size_t from = 0)
-      -> size_t {
+  static constexpr auto find_first_of(std::string_view str, char c,
+                                      size_t from = 0) -> size_t {
     return find(str, c, from);
   }
 
-  static auto substr(const std::string& str, size_t start,
-                     size_t n = std::string::npos) -> std::string {
+  static constexpr auto substr(std::string_view str, size_t start,
+                               size_t n = std::string_view::npos)
+      -> std::string_view {
     const std::size_t length = str.length();
     start = std::min(start, length);
     n = std::min(n, length - start);
     return str.substr(start, n);
   }
+
+  // 兼容旧接口：std::string 版本仅是对 std::string_view 版本的包装。
+  // 这些重载只接受 std::string 本身，字符串字面量和 const char* 仍然
+  // 匹配 std::string_view 版本，不会产生二义性。
+  template <typename S>
+  using IfString = std::enable_if_t<std::is_same_v<S, std::string>, int>;
+
+  template <typename S, IfString<S> = 0>
+  static auto ltrim(const S& str, const std::string& chars)
+      -> std::string {
+    return std::string(ltrim(std::string_view(str), chars));
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto rtrim(const S& str, const std::string& chars)
+      -> std::string {
+    return std::string(rtrim(std::string_view(str), chars));
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto trim(const S& str, const std::string& chars = " \t\n\v\f\r")
+      -> std::string {
+    return std::string(trim(std::string_view(str), chars));
+  }
+
+  static auto GetAutoSenseRadix(std::string& str) -> unsigned {
+    std::string_view view(str);
+    unsigned radix = GetAutoSenseRadix(view);
+    str.erase(0, str.size() - view.size());
+    return radix;
+  }
+
+  template <typename T>
+  static auto ConsumeInteger(std::string& str, unsigned radix, T& result)
+      -> bool {
+    std::string_view view(str);
+    bool failed = ConsumeInteger(view, radix, result);
+    str.erase(0, str.size() - view.size());
+    return failed;
+  }
+
+  template <typename S, typename PredicateT, IfString<S> = 0>
+  static auto take_while(const S& str, PredicateT f) -> std::string {
+    return std::string(take_while(std::string_view(str), f));
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto take_front(const S& str, std::size_t n = 1)
+      -> std::string {
+    return std::string(take_front(std::string_view(str), n));
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto drop_front(const S& str, std::size_t n = 1)
+      -> std::string {
+    return std::string(drop_front(std::string_view(str), n));
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto slice(const S& str, std::size_t start, std::size_t end)
+      -> std::string {
+    return std::string(slice(std::string_view(str), start, end));
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto find(const S& str, char c, size_t from = 0) -> size_t {
+    return find(std::string_view(str), c, from);
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto find_first_of(const S& str, char c, size_t from = 0)
+      -> size_t {
+    return find(str, c, from);
+  }
+
+  template <typename S, IfString<S> = 0>
+  static auto substr(const S& str, size_t start, size_t n = std::string::npos)
+      -> std::string {
+    return std::string(substr(std::string_view(str), start, n));
+  }
 };
 
 namespace Internal {
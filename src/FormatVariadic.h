@@ -3,15 +3,30 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include "FormatAlign.h"
+#include "FormatArgs.h"
+#include "FormatInstrument.h"
+#include "FormatMemory.h"
+#include "FormatProviders.h"
+#include "FormatRange.h"
+#include "FormatScan.h"
+#include "FormatSink.h"
+#include "FormatSmallString.h"
 #include "FormatUtil.h"
 #include "FormatVariadicDetails.h"
 
@@ -25,24 +40,27 @@ enum class ReplacementType : uint8_t {
 };
 
 // 保存每个替换项的格式说明详情。
+// spec 和 options 都是指向原始格式字符串的视图，
+// 因此 ReplacementItem 的生命周期不能超过它所解析的格式字符串。
 struct ReplacementItem {
-  ReplacementItem() = default;
-  explicit ReplacementItem(std::string literal)
-      : type(ReplacementType::Literal), spec(std::move(literal)) {}
-  ReplacementItem(std::string spec, size_t index, size_t align,
-                  AlignStyle where, char pad, std::string options)
+  constexpr ReplacementItem() = default;
+  constexpr explicit ReplacementItem(std::string_view literal)
+      : type(ReplacementType::Literal), spec(literal) {}
+  constexpr ReplacementItem(std::string_view spec, size_t index, size_t align,
+                            AlignStyle where, char pad,
+                            std::string_view options)
       : type(ReplacementType::Format),
-        spec(std::move(spec)),
+        spec(spec),
         index(index),
         align(align),
         where(where),
         pad(pad),
-        options(std::move(options)) {}
+        options(options) {}
 
   // 替换的类型。
   ReplacementType type = ReplacementType::Empty;
   // 来自格式的原始字符串。
-  std::string spec;
+  std::string_view spec;
   // 要替换的值的索引。
   size_t index = 0;
   // align, where, pad: 对齐的规格说明。
@@ -50,7 +68,186 @@ struct ReplacementItem {
   AlignStyle where = AlignStyle::Right; // 对齐样式。
   char pad = 0; // 填充字符。
   // 替换项的其他格式选项。
-  std::string options;
+  std::string_view options;
+};
+
+// 解析格式字符串时可能出现的错误。
+// 运行期解析遇到错误时会触发断言，编译期解析则将其报告为编译错误。
+enum class FormatError : uint8_t {
+  None,
+  InvalidIndex,        // 替换项的索引不是合法的整数。
+  InvalidLayout,       // `,` 之后的对齐规格无法解析。
+  UnexpectedCharacter, // 替换项中存在多余的字符。
+  UnterminatedBrace,   // `{` 没有对应的 `}`。
+  IndexOutOfRange,     // 替换项的索引超出了参数个数。
+};
+
+// 解析后的格式字符串：持有原始字符串以及由它解析出的替换项序列。
+// items 中的视图指向 fmt，因此该对象不可复制。
+struct ParsedFormat {
+  ParsedFormat() = default;
+  ParsedFormat(const ParsedFormat&) = delete;
+  auto operator=(const ParsedFormat&) -> ParsedFormat& = delete;
+
+  std::string fmt;
+  std::vector<ReplacementItem> items;
+
+  // 估算该对象占用的内存字节数，用于限制缓存大小。
+  auto ByteSize() const -> size_t {
+    return sizeof(ParsedFormat) + fmt.capacity() +
+           items.capacity() * sizeof(ReplacementItem);
+  }
+};
+
+// 进程级的格式字符串缓存。
+// 以 const char* 字面量地址为键，命中时再比较内容，
+// 保证同一个格式字符串在进程中只被解析一次。
+// 缓存按 LRU 淘汰，总内存不超过 capacity 字节。
+// 共享的 LRU 前面还有每个线程各自的小缓存，命中时不加锁，
+// 每 RefreshInterval 次命中才回到共享缓存更新一次 LRU 顺序，
+// 因此多个线程同时格式化时不会在同一把锁上排队。
+// 线程缓存持有解析结果的引用，被淘汰的条目最多在每个线程中
+// 再保留 LocalSlots 个，Clear() 和 SetCapacity() 会使它们全部失效。
+// 命中次数只有 Clear() 会清零。
+class FormatStringCache {
+ public:
+  static constexpr size_t DefaultCapacity = 1 << 20;
+  // 线程缓存的槽数，按地址直接映射。
+  static constexpr size_t LocalSlots = 64;
+  // 一个槽在线程缓存中连续命中这么多次后，经过共享缓存查找一次。
+  static constexpr size_t RefreshInterval = 64;
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t capacity = 0;
+  };
+
+  static auto Instance() -> FormatStringCache& {
+    static FormatStringCache cache;
+    return cache;
+  }
+
+  // 查找（必要时解析并插入）fmt 对应的解析结果。
+  auto Lookup(const char* fmt) -> std::shared_ptr<const ParsedFormat>;
+
+  auto GetStats() const -> Stats {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+    for (const LocalCache* local : locals_) {
+      if (local->epoch.load(std::memory_order_acquire) == epoch) {
+        stats.hits += local->hits.load(std::memory_order_relaxed);
+      }
+    }
+    stats.entries = lru_.size();
+    stats.bytes = bytes_;
+    stats.capacity = capacity_;
+    return stats;
+  }
+
+  // 设置缓存的内存上限（字节），超出部分立即淘汰。
+  void SetCapacity(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    capacity_ = bytes;
+    Shrink();
+    generation_.fetch_add(1, std::memory_order_release);
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    lru_.clear();
+    index_.clear();
+    bytes_ = 0;
+    stats_ = Stats{};
+    epoch_.fetch_add(1, std::memory_order_relaxed);
+    generation_.fetch_add(1, std::memory_order_release);
+  }
+
+ private:
+  struct Entry {
+    const char* key;
+    std::shared_ptr<const ParsedFormat> parsed;
+    size_t bytes;
+  };
+
+  // 一个线程的前端缓存。只有所属线程读写槽和 generation，
+  // hits 和 epoch 由 GetStats() 在其他线程读取。
+  struct LocalCache {
+    struct Slot {
+      const char* key = nullptr;
+      std::shared_ptr<const ParsedFormat> parsed;
+      size_t hits = 0;
+    };
+
+    explicit LocalCache(FormatStringCache& owner) : owner(owner) {
+      std::lock_guard<std::mutex> lock(owner.mutex_);
+      generation = owner.generation_.load(std::memory_order_relaxed);
+      epoch.store(owner.epoch_.load(std::memory_order_relaxed),
+                  std::memory_order_relaxed);
+      owner.locals_.push_back(this);
+    }
+
+    // 线程退出时把命中次数并入共享的统计。
+    ~LocalCache() {
+      std::lock_guard<std::mutex> lock(owner.mutex_);
+      if (epoch.load(std::memory_order_relaxed) ==
+          owner.epoch_.load(std::memory_order_relaxed)) {
+        owner.stats_.hits += hits.load(std::memory_order_relaxed);
+      }
+      owner.locals_.erase(
+          std::find(owner.locals_.begin(), owner.locals_.end(), this));
+    }
+
+    LocalCache(const LocalCache&) = delete;
+    auto operator=(const LocalCache&) -> LocalCache& = delete;
+
+    FormatStringCache& owner;
+    std::array<Slot, LocalSlots> slots;
+    uint64_t generation = 0;
+    // hits 所属的统计周期，与 epoch_ 不同时不计入统计。
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<size_t> hits{0};
+  };
+
+  FormatStringCache() = default;
+
+  // 在共享的 LRU 中查找，命中时移到最前面。
+  auto LookupShared(const char* fmt) -> std::shared_ptr<const ParsedFormat>;
+
+  void Shrink() {
+    while (bytes_ > capacity_ && !lru_.empty()) {
+      const Entry& victim = lru_.back();
+      bytes_ -= victim.bytes;
+      index_.erase(victim.key);
+      lru_.pop_back();
+      ++stats_.evictions;
+    }
+  }
+
+  mutable std::mutex mutex_;
+  // 每次 Clear() 或 SetCapacity() 加一，线程缓存据此丢弃旧的槽。
+  std::atomic<uint64_t> generation_{0};
+  // 每次 Clear() 加一，线程缓存据此清零命中次数。
+  std::atomic<uint64_t> epoch_{0};
+  std::vector<LocalCache*> locals_;
+  std::list<Entry> lru_;
+  std::unordered_map<const char*, std::list<Entry>::iterator> index_;
+  size_t bytes_ = 0;
+  size_t capacity_ = DefaultCapacity;
+  Stats stats_;
+};
+
+// format_to_n 的结果。
+template <typename OutputIt>
+struct FormatToNResult {
+  // 指向已写入内容末尾的迭代器。
+  OutputIt out;
+  // 完整输出所需的字节数，大于 n 表示输出被截断。
+  size_t size;
 };
 
 class FormatvObjectBase;
@@ -64,62 +261,193 @@ class FormatvObjectBase {
   FormatvObjectBase(const FormatvObjectBase&) = delete;
   auto operator=(const FormatvObjectBase&) -> FormatvObjectBase& = delete;
 
-  // 根据替换项格式化字符串并将其写入给定的ostream。
-  void format(std::ostream& os) const {
-    for (auto& r : ParseFormatString(fmt_)) {
-      switch (r.type) {
-        case ReplacementType::Empty:
-          continue;
-        case ReplacementType::Literal:
-          os << r.spec;
-          continue;
-        case ReplacementType::Format: {
-          if (r.index >= adapters_.size()) {
-            os << r.spec;
-            continue;
-          }
+  // 根据替换项格式化字符串并将其写入给定的sink。
+  void format(FormatSink& os) const {
+    Internal::FormatSiteScope scope([this] { return Site(); });
+    size_t start = os.count();
+    for (const auto& r : replacements_) {
+      FormatItem(os, r, args_);
+    }
+    scope.AddBytes(os.count() - start);
+  }
 
-          auto* w = adapters_[r.index];
-          FormatAlign align(*w, r.where, r.align, r.pad);
+  // 将单个替换项写入 sink：字面量原样输出，索引越界的替换项输出原始文本。
+  static void FormatItem(FormatSink& os, const ReplacementItem& r,
+                         ArrayRef<Internal::FormatArg> args) {
+    switch (r.type) {
+      case ReplacementType::Literal:
+        os.write(r.spec);
+        break;
+      case ReplacementType::Format:
+        if (r.index >= args.size()) {
+          os.write(r.spec);
+        } else {
+          FormatAlign align(args[r.index], r.where, r.align, r.pad);
           align.format(os, r.options);
         }
-        default:
-          continue;
+        break;
+      default:
+        break;
+    }
+  }
+
+  // 根据替换项格式化字符串并将其写入给定的ostream。
+  void format(std::ostream& os) const {
+    StreamSink sink(os);
+    format(sink);
+  }
+
+  // 将格式化结果写入输出迭代器，返回指向输出末尾的迭代器。
+  template <typename OutputIt>
+  auto format_to(OutputIt out) const -> OutputIt {
+    IteratorSink<OutputIt> sink(out);
+    format(sink);
+    return sink.out();
+  }
+
+  // 最多写入 n 个字符，超出部分被截断，但 size 仍报告完整长度。
+  // 目标为 char* 时直接写入调用方的缓冲区。
+  template <typename OutputIt>
+  auto format_to_n(OutputIt out, size_t n) const -> FormatToNResult<OutputIt> {
+    if constexpr (std::is_same_v<OutputIt, char*>) {
+      FixedBufferSink sink(out, n);
+      format(sink);
+      return {out + sink.written(), sink.count()};
+    } else {
+      IteratorSink<OutputIt> sink(out, n);
+      format(sink);
+      OutputIt end = sink.out();
+      return {end, sink.count()};
+    }
+  }
+
+  // 依次对格式字符串中的每个替换项调用 f，整个过程不分配内存。
+  // 若提供 error，解析错误会记录在其中而不是触发断言。
+  template <typename F>
+  static constexpr void VisitFormatString(std::string_view fmt, F&& f,
+                                          FormatError* error = nullptr) {
+    while (!fmt.empty()) {
+      auto [item, rest] = SplitLiteralAndReplacement(fmt, error);
+      fmt = rest;
+      if (item.type != ReplacementType::Empty) {
+        f(item);
       }
     }
   }
 
   // 解析格式字符串以获取替换项列表。
-  static auto ParseFormatString(std::string fmt)
+  // 返回的替换项引用 fmt 的内容，调用者需保证 fmt 在使用期间有效。
+  // 运行期先用 SIMD 一次找出所有花括号，再按位置直接切分字面量和替换项，
+  // 长模板中的字面量不再逐段查找；结果与 VisitFormatString 完全一致。
+  static auto ParseFormatString(std::string_view fmt)
       -> std::vector<ReplacementItem> {
+    Internal::ParseScope scope(fmt);
     std::vector<ReplacementItem> replacements;
-    ReplacementItem i;
-    while (!fmt.empty()) {
-      std::tie(i, fmt) = SplitLiteralAndReplacement(fmt);
-      if (i.type != ReplacementType::Empty) {
+    // 短模板的扫描开销不值得，超长模板的位置无法用 32 位表示。
+    if (fmt.size() < MinScanSize || fmt.size() > UINT32_MAX) {
+      VisitFormatString(fmt, [&](const ReplacementItem& i) {
+        size_t capacity = replacements.capacity();
         replacements.push_back(i);
+        Internal::NoteGrowth(capacity, replacements.capacity(),
+                             sizeof(ReplacementItem));
+      });
+      return replacements;
+    }
+
+    thread_local Internal::BracePositions braces;
+    Internal::ScanBraces(fmt, braces);
+    // 每个 { 最多带来一个替换项和其后的一段字面量。
+    replacements.reserve(braces.opens.size() * 2 + 1);
+    Internal::NoteGrowth(0, replacements.capacity(), sizeof(ReplacementItem));
+    Internal::BraceCursor opens(braces.opens);
+    Internal::BraceCursor closes(braces.closes);
+
+    size_t pos = 0;
+    while (pos < fmt.size()) {
+      // 到下一个 { 之前的字面量。
+      if (fmt[pos] != '{') {
+        size_t bo = std::min(opens.NextFrom(pos), fmt.size());
+        replacements.emplace_back(fmt.substr(pos, bo - pos));
+        pos = bo;
+        continue;
+      }
+
+      // 连续的 {{ 转义为一半数量的 {。
+      size_t run = 1;
+      while (pos + run < fmt.size() && fmt[pos + run] == '{') {
+        ++run;
+      }
+      if (run > 1) {
+        replacements.emplace_back(fmt.substr(pos, run / 2));
+        pos += run / 2 * 2;
+        continue;
       }
+
+      size_t bc = closes.NextFrom(pos);
+      if (bc == std::string_view::npos) {
+        assert(false &&
+               "Unterminated brace sequence.  Escape with {{ for a literal "
+               "brace.");
+        replacements.emplace_back(fmt.substr(pos));
+        break;
+      }
+
+      // 嵌套的 { 之前的部分作为字面量。
+      size_t bo2 = opens.NextFrom(pos + 1);
+      if (bo2 < bc) {
+        replacements.emplace_back(fmt.substr(pos, bo2 - pos));
+        pos = bo2;
+        continue;
+      }
+
+      auto ri = ParseReplacementItem(fmt.substr(pos + 1, bc - pos - 1));
+      if (ri && ri->type != ReplacementType::Empty) {
+        replacements.push_back(*ri);
+      }
+      pos = bc + 1;
     }
     return replacements;
   }
 
+  // 检查格式字符串能否被完整解析，且所有索引都小于 num_args。
+  static constexpr auto ValidateFormatString(std::string_view fmt,
+                                             size_t num_args) -> FormatError {
+    FormatError error = FormatError::None;
+    VisitFormatString(
+        fmt,
+        [&](const ReplacementItem& item) {
+          if (item.type == ReplacementType::Format && item.index >= num_args &&
+              error == FormatError::None) {
+            error = FormatError::IndexOutOfRange;
+          }
+        },
+        &error);
+    return error;
+  }
+
+  // 不短于该长度的格式字符串在运行期解析时先整体扫描花括号。
+  static constexpr size_t MinScanSize = 256;
+
   // 将单个替换规格解析为ReplacementItem。
-  static auto ParseReplacementItem(std::string spec)
+  static constexpr auto ParseReplacementItem(std::string_view spec,
+                                             FormatError* error = nullptr)
       -> std::optional<ReplacementItem> {
     // 移除 spec 字符串的 { 和 }。
-    std::string rep_string = FormatUtil::trim(spec, "{}");
+    std::string_view rep_string = FormatUtil::trim(spec, "{}");
 
     char pad = ' ';
     std::size_t align = 0;
     AlignStyle where = AlignStyle::Right;
-    std::string options;
+    std::string_view options;
     size_t index = 0;
 
     // 移除 rep_string 的前后空白字符。
     rep_string = FormatUtil::trim(rep_string);
     // 尝试从 rep_string 开始的位置解析一个整数，并将其赋值给 index。
     if (FormatUtil::ConsumeInteger(rep_string, 0, index)) {
-      assert(false && "Invalid replacement sequence index!");
+      if (!RecordError(error, FormatError::InvalidIndex)) {
+        assert(false && "Invalid replacement sequence index!");
+      }
       return ReplacementItem{};
     }
 
@@ -131,7 +459,9 @@ class FormatvObjectBase {
     if (!rep_string.empty() && rep_string.front() == ',') {
       rep_string = FormatUtil::drop_front(rep_string, 1);
       if (!ConsumeFieldLayout(rep_string, where, align, pad)) {
-        assert(false && "Invalid replacement field layout specification!");
+        if (!RecordError(error, FormatError::InvalidLayout)) {
+          assert(false && "Invalid replacement field layout specification!");
+        }
       }
     }
 
@@ -143,39 +473,97 @@ class FormatvObjectBase {
     if (!rep_string.empty() && rep_string.front() == ':') {
       rep_string = FormatUtil::drop_front(rep_string, 1);
       options = FormatUtil::trim(rep_string);
-      rep_string = "";
+      rep_string = std::string_view();
     }
 
     rep_string = FormatUtil::trim(rep_string);
     if (!rep_string.empty()) {
-      assert(false && "Unexpected characters found in replacement string!");
+      if (!RecordError(error, FormatError::UnexpectedCharacter)) {
+        assert(false && "Unexpected characters found in replacement string!");
+      }
     }
 
     return ReplacementItem{spec, index, align, where, pad, options};
   }
 
+  // 计算格式化结果的精确长度。
+  // 字面量和能报告长度的参数直接累加，其余参数格式化到 CountingSink 中计数。
+  auto formatted_size() const -> size_t {
+    size_t size = 0;
+    for (const auto& r : replacements_) {
+      if (r.type == ReplacementType::Literal ||
+          (r.type == ReplacementType::Format && r.index >= args_.size())) {
+        size += r.spec.size();
+      } else if (r.type == ReplacementType::Format) {
+        FormatAlign align(args_[r.index], r.where, r.align, r.pad);
+        size += align.formatted_size(r.options);
+      }
+    }
+    return size;
+  }
+
   // 返回格式化的字符串。
-  auto str() const -> std::string {
-    std::ostringstream stream;
-    stream << *this;
-    std::string result = stream.str();
-    stream.flush();
+  // 所有参数都能廉价报告长度时预先分配恰好的空间，只分配一次内存；
+  // 否则不做预计算，直接按需增长，避免把参数格式化两次。
+  auto str() const -> std::string { return to<std::string>(); }
+
+  // 格式化为指定的字符串类型，例如在栈上保存结果的 SmallString：
+  //   auto msg = formatv("{0}: {1}", key, value).to<SmallString<128>>();
+  // String 需满足 BasicStringSink 的要求，并提供 reserve()。
+  template <typename String>
+  auto to() const -> String {
+    // 预分配的内存也计入这次调用。
+    Internal::FormatSiteScope scope([this] { return Site(); });
+    String result;
+    if (auto size = size_hint()) {
+      size_t capacity = result.capacity();
+      result.reserve(*size);
+      Internal::NoteGrowth(capacity, result.capacity());
+    }
+    {
+      BasicStringSink<String> sink(result);
+      format(sink);
+    }
     return result;
   }
 
+  // 格式化到当前线程的 BufferPool 借出的缓冲区中，句柄析构时归还。
+  // 缓冲区保留上次的容量，稳态下反复调用不再分配内存。
+  auto pooled_str() const -> PooledBuffer {
+    PooledBuffer buffer = BufferPool::ThreadLocal().Acquire();
+    {
+      StringSink sink(buffer.str());
+      format(sink);
+    }
+    return buffer;
+  }
+
   // 将对象转换为字符串。
   operator std::string() const { return str(); }
 
  protected:
-  FormatvObjectBase(std::string fmt,
-                    ArrayRef<Internal::FormatAdapter*> adapters)
-      : fmt_(std::move(fmt)), adapters_(adapters.begin(), adapters.end()) {}
+  FormatvObjectBase(const char* fmt, ArrayRef<Internal::FormatArg> args)
+      : parsed_(FormatStringCache::Instance().Lookup(fmt)),
+        replacements_(parsed_->items),
+        args_(args) {}
+
+  // 非字面量的格式字符串不进入缓存，直接解析并由对象独占。
+  FormatvObjectBase(std::string fmt, ArrayRef<Internal::FormatArg> args)
+      : parsed_(Parse(std::move(fmt))),
+        replacements_(parsed_->items),
+        args_(args) {}
+
+  // 使用编译期解析好的替换项表，运行期不做任何解析。
+  FormatvObjectBase(ArrayRef<ReplacementItem> replacements,
+                    ArrayRef<Internal::FormatArg> args)
+      : replacements_(replacements), args_(args) {}
 
   FormatvObjectBase(FormatvObjectBase&&) = default;
 
   // 解析对齐、填充和宽度规格。
-  static auto ConsumeFieldLayout(std::string& spec, AlignStyle& where,
-                                 size_t& align, char& pad) -> bool {
+  static constexpr auto ConsumeFieldLayout(std::string_view& spec,
+                                           AlignStyle& where, size_t& align,
+                                           char& pad) -> bool {
     where = AlignStyle::Right;
     align = 0;
     pad = ' ';
@@ -198,11 +586,43 @@ class FormatvObjectBase {
     return !failed;
   }
 
+  // 不实际格式化参数就能得到的输出长度。
+  auto size_hint() const -> std::optional<size_t> {
+    size_t size = 0;
+    for (const auto& r : replacements_) {
+      if (r.type == ReplacementType::Literal ||
+          (r.type == ReplacementType::Format && r.index >= args_.size())) {
+        size += r.spec.size();
+      } else if (r.type == ReplacementType::Format) {
+        FormatAlign align(args_[r.index], r.where, r.align, r.pad);
+        auto field = align.size_hint(r.options);
+        if (!field) {
+          return std::nullopt;
+        }
+        size += *field;
+      }
+    }
+    return size;
+  }
+
+  // 记录第一个解析错误。未提供 error 时返回 false，由调用方触发断言。
+  static constexpr auto RecordError(FormatError* error, FormatError e)
+      -> bool {
+    if (error == nullptr) {
+      return false;
+    }
+    if (*error == FormatError::None) {
+      *error = e;
+    }
+    return true;
+  }
+
   // 从输入的 fmt 字符串中分离字面量和替换项。
   // 即它寻找 `{...}` 结构中的替换项，并将其与其前面的字面量一起返回。
   // 如果找到一个连续的 `{` 或者 `{{`，它将按照适当的逻辑对其进行处理。
-  static auto SplitLiteralAndReplacement(std::string fmt)
-      -> std::pair<ReplacementItem, std::string> {
+  static constexpr auto SplitLiteralAndReplacement(
+      std::string_view fmt, FormatError* error = nullptr)
+      -> std::pair<ReplacementItem, std::string_view> {
     while (!fmt.empty()) {
       // 处理没有 { 开头的字符串。
       if (fmt.front() != '{') {
@@ -213,24 +633,28 @@ class FormatvObjectBase {
 
       // 处理连续的 { 字符。
       // 如果找到一个或多个 {，它会尝试获取连续的 { 个数，并将其保存在 braces 中。
-      std::string braces =
+      std::string_view braces =
           FormatUtil::take_while(fmt, [](char c) { return c == '{'; });
       // 如果连续的 `{` 个数大于1（即 `{{`），它将其解释为转义字符，
       // 并只保留其中一半作为字面量返回。剩下的部分被视为后续的字符串。
       if (braces.size() > 1) {
         size_t num_excaped_braces = braces.size() / 2;
-        std::string middle = FormatUtil::take_front(fmt, num_excaped_braces);
-        std::string right = FormatUtil::drop_front(fmt, num_excaped_braces * 2);
+        std::string_view middle =
+            FormatUtil::take_front(fmt, num_excaped_braces);
+        std::string_view right =
+            FormatUtil::drop_front(fmt, num_excaped_braces * 2);
         return std::make_pair(ReplacementItem{middle}, right);
       }
 
       // 查找匹配的 }。
       std::size_t bc = FormatUtil::find_first_of(fmt, '}');
-      if (bc == std::string::npos) {
-        assert(false &&
-               "Unterminated brace sequence.  Escape with {{ for a literal "
-               "brace.");
-        return std::make_pair(ReplacementItem{fmt}, std::string());
+      if (bc == std::string_view::npos) {
+        if (!RecordError(error, FormatError::UnterminatedBrace)) {
+          assert(false &&
+                 "Unterminated brace sequence.  Escape with {{ for a literal "
+                 "brace.");
+        }
+        return std::make_pair(ReplacementItem{fmt}, std::string_view());
       }
 
       // 查找嵌套的 {。
@@ -242,10 +666,10 @@ class FormatvObjectBase {
 
       // 处理格式说明符。
       // 在 { 和 } 之间的字符串被视为替换项的格式说明符。
-      std::string spec = FormatUtil::slice(fmt, 1, bc);
-      std::string right = FormatUtil::substr(fmt, bc + 1);
+      std::string_view spec = FormatUtil::slice(fmt, 1, bc);
+      std::string_view right = FormatUtil::substr(fmt, bc + 1);
       // 调用 ParseReplacementItem 函数来解析这个说明符。
-      auto ri = ParseReplacementItem(spec);
+      auto ri = ParseReplacementItem(spec, error);
       // 解析成功，它返回解析得到的 ReplacementItem 和 } 之后的字符串。
       if (ri) {
         return std::make_pair(*ri, right);
@@ -255,14 +679,158 @@ class FormatvObjectBase {
       fmt = FormatUtil::drop_front(fmt, bc + 1);
     }
     // 遍历完整个 fmt 字符串仍然没有找到任何替换项，它将返回整个字符串作为字面量。
-    return std::make_pair(ReplacementItem{fmt}, std::string());
+    return std::make_pair(ReplacementItem{fmt}, std::string_view());
+  }
+
+  // 插桩数据的条目。运行期解析的格式字符串以解析时的字符串地址为键，
+  // 与 ParseFormatString 的统计合并；其余的以替换项表的地址为键。
+  // 两者都可能在释放后被重用，由注册表按文本区分。
+  auto Site() const -> Internal::InstrumentCounters* {
+    InstrumentRegistry& registry = InstrumentRegistry::Instance();
+    if (parsed_) {
+      return registry.Site(parsed_->fmt.data(), std::string_view(parsed_->fmt));
+    }
+    return registry.Site(
+        replacements_.data(),
+        [this](std::string_view fmt) { return SiteTextEquals(fmt); },
+        [this] { return SiteText(); });
   }
 
-  std::string fmt_;
+  // 插桩数据中显示的格式字符串。编译期的替换项表没有保存原始字符串，
+  // 由替换项重新拼出，字面量中的花括号按转义写回。
+  auto SiteText() const -> std::string {
+    if (parsed_) {
+      return parsed_->fmt;
+    }
+    std::string text;
+    for (const auto& r : replacements_) {
+      if (r.type == ReplacementType::Format) {
+        text += '{';
+        text += r.spec;
+        text += '}';
+        continue;
+      }
+      for (char c : r.spec) {
+        text += c;
+        if (c == '{') {
+          text += c;
+        }
+      }
+    }
+    return text;
+  }
 
-  ArrayRef<Internal::FormatAdapter*> adapters_;
+  // 与 SiteText() == text 相同，但不生成字符串，每次调用时用来确认条目。
+  auto SiteTextEquals(std::string_view text) const -> bool {
+    auto consume = [&text](char c) {
+      if (text.empty() || text.front() != c) {
+        return false;
+      }
+      text.remove_prefix(1);
+      return true;
+    };
+    for (const auto& r : replacements_) {
+      if (r.type == ReplacementType::Format) {
+        if (!consume('{') || text.substr(0, r.spec.size()) != r.spec) {
+          return false;
+        }
+        text.remove_prefix(r.spec.size());
+        if (!consume('}')) {
+          return false;
+        }
+        continue;
+      }
+      for (char c : r.spec) {
+        if (!consume(c) || (c == '{' && !consume(c))) {
+          return false;
+        }
+      }
+    }
+    return text.empty();
+  }
+
+  static auto Parse(std::string fmt) -> std::shared_ptr<const ParsedFormat> {
+    auto parsed = std::make_shared<ParsedFormat>();
+    // 先保存字符串再解析，使替换项中的视图指向 parsed->fmt。
+    parsed->fmt = std::move(fmt);
+    parsed->items = ParseFormatString(parsed->fmt);
+    return parsed;
+  }
+
+  // 运行期解析结果的所有者；使用编译期替换项表时为空。
+  std::shared_ptr<const ParsedFormat> parsed_;
+
+  ArrayRef<ReplacementItem> replacements_;
+
+  ArrayRef<Internal::FormatArg> args_;
+
+  friend class FormatStringCache;
 };
 
+inline auto FormatStringCache::Lookup(const char* fmt)
+    -> std::shared_ptr<const ParsedFormat> {
+  thread_local LocalCache local(*this);
+  uint64_t generation = generation_.load(std::memory_order_acquire);
+  if (local.generation != generation) {
+    for (auto& slot : local.slots) {
+      slot = {};
+    }
+    local.generation = generation;
+  }
+  uint64_t epoch = epoch_.load(std::memory_order_relaxed);
+  if (local.epoch.load(std::memory_order_relaxed) != epoch) {
+    local.hits.store(0, std::memory_order_relaxed);
+    local.epoch.store(epoch, std::memory_order_release);
+  }
+
+  auto key = reinterpret_cast<uintptr_t>(fmt);
+  auto& slot = local.slots[(key ^ (key >> 6)) % LocalSlots];
+  // 与共享缓存一样，地址相同时还要比较内容。
+  if (slot.key == fmt && std::strcmp(slot.parsed->fmt.c_str(), fmt) == 0 &&
+      ++slot.hits % RefreshInterval != 0) {
+    local.hits.store(local.hits.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+    return slot.parsed;
+  }
+  std::shared_ptr<const ParsedFormat> parsed = LookupShared(fmt);
+  slot = {fmt, parsed, 0};
+  return parsed;
+}
+
+inline auto FormatStringCache::LookupShared(const char* fmt)
+    -> std::shared_ptr<const ParsedFormat> {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(fmt);
+    if (it != index_.end()) {
+      // 同一地址可能被复用为不同内容的缓冲区，因此需要比较内容。
+      if (std::strcmp(it->second->parsed->fmt.c_str(), fmt) == 0) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        ++stats_.hits;
+        return it->second->parsed;
+      }
+      bytes_ -= it->second->bytes;
+      lru_.erase(it->second);
+      index_.erase(it);
+    }
+    ++stats_.misses;
+  }
+
+  // 在锁外解析，避免阻塞其他线程的查找。
+  std::shared_ptr<const ParsedFormat> parsed = FormatvObjectBase::Parse(fmt);
+  size_t bytes = parsed->ByteSize() + sizeof(Entry);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (bytes > capacity_ || index_.count(fmt) != 0) {
+    return parsed;
+  }
+  lru_.push_front(Entry{fmt, parsed, bytes});
+  index_.emplace(fmt, lru_.begin());
+  bytes_ += bytes;
+  Shrink();
+  return parsed;
+}
+
 // 允许直接将格式化的结果流式传输到输出流。
 inline auto operator<<(std::ostream& os, const FormatvObjectBase& obj)
     -> std::ostream& {
@@ -271,41 +839,138 @@ inline auto operator<<(std::ostream& os, const FormatvObjectBase& obj)
 }
 
 // 表示具有特定参数的格式化操作的模板类。
-// 它捕获格式字符串和作为元组的格式化值。
-// 保存每个参数的格式适配器的指针，这些适配器知道如何格式化该特定类型。
+// 它捕获格式字符串和作为元组的格式化值，
+// 并为每个参数保存一个类型擦除的 FormatArg。
 template <typename Tuple>
 class FormatvObject : public FormatvObjectBase {
  public:
-  FormatvObject(std::string fmt, Tuple&& params)
-      : FormatvObjectBase(fmt, parameter_pointers_),
+  FormatvObject(const char* fmt, Tuple&& params)
+      : FormatvObjectBase(fmt, parameter_args_),
+        parameters_(std::move(params)),
+        parameter_args_(std::apply(CreateArgs(), parameters_)) {}
+
+  FormatvObject(ArrayRef<ReplacementItem> replacements, Tuple&& params)
+      : FormatvObjectBase(replacements, parameter_args_),
         parameters_(std::move(params)),
-        parameter_pointers_(std::apply(CreateAdapters(), parameters_)) {}
+        parameter_args_(std::apply(CreateArgs(), parameters_)) {}
 
   FormatvObject(const FormatvObject& rhs) = delete;
 
   FormatvObject(FormatvObject&& rhs)
       : FormatvObjectBase(std::move(rhs)),
         parameters_(std::move(rhs.parameters_)) {
-    parameter_pointers_ = std::apply(CreateAdapters(), parameters_);
-    adapters_ = parameter_pointers_;
+    parameter_args_ = std::apply(CreateArgs(), parameters_);
+    args_ = parameter_args_;
   }
 
  private:
-  // 创建格式适配器。
-  struct CreateAdapters {
+  // 创建类型擦除的参数。
+  struct CreateArgs {
     template <typename... Ts>
-    auto operator()(Ts&... items)
-        -> std::array<Internal::FormatAdapter*, std::tuple_size<Tuple>::value> {
-      return {{&items...}};
+    auto operator()(const Ts&... items)
+        -> std::array<Internal::FormatArg, std::tuple_size<Tuple>::value> {
+      return {{Internal::FormatArg::Make(items)...}};
     }
   };
 
   Tuple parameters_;
 
-  std::array<Internal::FormatAdapter*, std::tuple_size<Tuple>::value>
-      parameter_pointers_;
+  std::array<Internal::FormatArg, std::tuple_size<Tuple>::value>
+      parameter_args_;
+};
+
+// 只引用外部参数的格式化对象，由 formatv_ref 和 vformatv 返回。
+// 参数以 FormatArgStore 或 ArrayRef<FormatArg> 的形式传入，
+// 不复制参数，移动时也不需要重建参数表。
+template <size_t N>
+class FormatvRefObject : public FormatvObjectBase {
+ public:
+  template <typename... Ts>
+  explicit FormatvRefObject(const char* fmt, const Ts&... vals)
+      : FormatvObjectBase(fmt, {store_.data(), N}),
+        store_(std::in_place, vals...) {}
+
+  template <typename... Ts>
+  explicit FormatvRefObject(ArrayRef<ReplacementItem> replacements,
+                            const Ts&... vals)
+      : FormatvObjectBase(replacements, {store_.data(), N}),
+        store_(std::in_place, vals...) {}
+
+  FormatvRefObject(const FormatvRefObject& rhs) = delete;
+
+  FormatvRefObject(FormatvRefObject&& rhs)
+      : FormatvObjectBase(std::move(rhs)), store_(rhs.store_) {
+    args_ = store_;
+  }
+
+ private:
+  FormatArgStore<N> store_;
+};
+
+// 参数表由调用方持有的版本，对象本身不保存任何参数。
+template <>
+class FormatvRefObject<0> : public FormatvObjectBase {
+ public:
+  explicit FormatvRefObject(const char* fmt,
+                            ArrayRef<Internal::FormatArg> args = {})
+      : FormatvObjectBase(fmt, args) {}
+
+  explicit FormatvRefObject(ArrayRef<ReplacementItem> replacements,
+                            ArrayRef<Internal::FormatArg> args = {})
+      : FormatvObjectBase(replacements, args) {}
+
+  FormatvRefObject(const FormatvRefObject& rhs) = delete;
+  FormatvRefObject(FormatvRefObject&& rhs) = default;
 };
 
+namespace Internal {
+
+constexpr auto CountReplacements(std::string_view fmt) -> size_t {
+  size_t count = 0;
+  FormatvObjectBase::VisitFormatString(
+      fmt, [&](const ReplacementItem& /*unused*/) { ++count; });
+  return count;
+}
+
+template <size_t N>
+constexpr auto ParseFormatArray(std::string_view fmt)
+    -> std::array<ReplacementItem, N> {
+  std::array<ReplacementItem, N> items{};
+  size_t i = 0;
+  FormatvObjectBase::VisitFormatString(
+      fmt, [&](const ReplacementItem& item) { items[i++] = item; });
+  return items;
+}
+
+// 在编译期解析 S::data() 得到的替换项表，具有静态存储期。
+template <typename S, size_t NumArgs>
+struct StaticFormat {
+  static constexpr FormatError Error =
+      FormatvObjectBase::ValidateFormatString(S::data(), NumArgs);
+  static constexpr std::array<ReplacementItem, CountReplacements(S::data())>
+      Items = ParseFormatArray<CountReplacements(S::data())>(S::data());
+};
+
+// 返回 S 的替换项表，格式错误时在编译期报错。
+template <typename S, size_t NumArgs>
+constexpr auto StaticFormatItems() -> ArrayRef<ReplacementItem> {
+  using Format = StaticFormat<S, NumArgs>;
+  static_assert(Format::Error != FormatError::InvalidIndex,
+                "Invalid replacement sequence index!");
+  static_assert(Format::Error != FormatError::InvalidLayout,
+                "Invalid replacement field layout specification!");
+  static_assert(Format::Error != FormatError::UnexpectedCharacter,
+                "Unexpected characters found in replacement string!");
+  static_assert(Format::Error != FormatError::UnterminatedBrace,
+                "Unterminated brace sequence. Escape with {{ for a literal "
+                "brace.");
+  static_assert(Format::Error != FormatError::IndexOutOfRange,
+                "Replacement index is out of range of the arguments!");
+  return Format::Items;
+}
+
+}  // namespace Internal
+
 ///   // 用户创建格式化字符串的主要接口。
 ///   // Convert to std::string.
 ///   std::string S = formatv("{0} {1}", 1234.412, "test").str();
@@ -313,15 +978,65 @@ class FormatvObject : public FormatvObjectBase {
 ///   OS << formatv("{0} {1}", 1234.412, "test");
 template <typename... Ts>
 inline auto formatv(const char* fmt, Ts&&... vals)
-    -> FormatvObject<decltype(std::make_tuple(
-        Internal::build_format_adapter(std::forward<Ts>(vals))...))> {
-  using ParamTuple = decltype(std::make_tuple(
-      Internal::build_format_adapter(std::forward<Ts>(vals))...));
+    -> FormatvObject<std::tuple<Internal::StoredArg<Ts>...>> {
+  using ParamTuple = std::tuple<Internal::StoredArg<Ts>...>;
+  return FormatvObject<ParamTuple>(fmt,
+                                   ParamTuple(std::forward<Ts>(vals)...));
+}
+
+// 编译期格式字符串版本：解析和校验都在编译期完成。
+template <typename S, typename... Ts>
+inline auto formatv(S /*fmt*/, Ts&&... vals)
+    -> std::enable_if_t<std::is_base_of_v<CompileString, S>,
+                        FormatvObject<std::tuple<Internal::StoredArg<Ts>...>>> {
+  using ParamTuple = std::tuple<Internal::StoredArg<Ts>...>;
   return FormatvObject<ParamTuple>(
-      fmt, std::make_tuple(
-               Internal::build_format_adapter(std::forward<Ts>(vals))...));
+      Internal::StaticFormatItems<S, sizeof...(Ts)>(),
+      ParamTuple(std::forward<Ts>(vals)...));
+}
+
+// 按引用捕获参数的 formatv，不复制也不移动任何参数。
+// 返回的对象引用 vals，只能在同一个表达式中立即使用：
+//   std::string s = formatv_ref("{0} {1}", name, big_object).str();
+template <typename... Ts>
+inline auto formatv_ref(const char* fmt, const Ts&... vals)
+    -> FormatvRefObject<sizeof...(Ts)> {
+  return FormatvRefObject<sizeof...(Ts)>(fmt, vals...);
+}
+
+template <typename S, typename... Ts>
+inline auto formatv_ref(S /*fmt*/, const Ts&... vals)
+    -> std::enable_if_t<std::is_base_of_v<CompileString, S>,
+                        FormatvRefObject<sizeof...(Ts)>> {
+  return FormatvRefObject<sizeof...(Ts)>(
+      Internal::StaticFormatItems<S, sizeof...(Ts)>(), vals...);
+}
+
+// 使用调用方持有的参数表格式化，fmt 经过格式字符串缓存解析。
+inline auto vformatv(const char* fmt, ArrayRef<Internal::FormatArg> args)
+    -> FormatvRefObject<0> {
+  return FormatvRefObject<0>(fmt, args);
+}
+
+// 边解析边输出，既不查缓存也不保存 fmt，整个过程不分配内存。
+// 适合只使用一次、不值得缓存的格式字符串。
+inline void vformat_to(FormatSink& os, std::string_view fmt,
+                       ArrayRef<Internal::FormatArg> args) {
+  FormatvObjectBase::VisitFormatString(fmt, [&](const ReplacementItem& r) {
+    FormatvObjectBase::FormatItem(os, r, args);
+  });
+}
+
+inline auto vformat(std::string_view fmt, ArrayRef<Internal::FormatArg> args)
+    -> std::string {
+  std::string result;
+  {
+    StringSink sink(result);
+    vformat_to(sink, fmt, args);
+  }
+  return result;
 }
 
 }  // namespace Formatv
 
-#endif  // FORMATV_FORMAT_VARIADIC_H
\ No newline at end of file
+#endif  // FORMATV_FORMAT_VARIADIC_H
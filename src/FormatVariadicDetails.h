@@ -1,79 +1,103 @@
 #ifndef FORMATV_FORMAT_VARIADIC_DETAILS_H
 #define FORMATV_FORMAT_VARIADIC_DETAILS_H
 
-#include <iostream>
+#include <cstdint>
+#include <optional>
 #include <ostream>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
+#include "FormatSink.h"
+
 namespace Formatv {
 
+enum class AlignStyle : uint8_t {
+  Left,    // "-"
+  Center,  // "="
+  Right,   // "+"
+};
+
 // 这是一个模板结构，充当自定义的格式提供者。
-// 用户应该为特定的类型特化这个模板以提供格式化功能。
+// 用户应该为特定的类型特化这个模板以提供格式化功能：
+//   static void format(const T&, FormatSink&, std::string_view options);
+// 如果能不格式化就算出输出长度，还可以提供：
+//   static size_t formatted_size(const T&, std::string_view options);
+// 旧版本的签名 format(const T&, std::ostream&, std::string options)
+// 仍然支持，通过包装了 sink 的临时 std::ostream 调用，建议迁移到 FormatSink。
 template <typename T, typename Enable = void>
 struct FormatProvider {};
 
-namespace Internal {
-
-// 它是一个抽象基类，定义了一个纯虚函数format。所有适配器类都需要继承这个基类并实现这个函数。
-class FormatAdapter {
- public:
-  virtual void format(std::ostream& os, std::string options) = 0;
+// 编译期格式字符串的标记基类，由 FORMATV_STR 生成其派生类型。
+struct CompileString {};
+
+// 将字符串字面量包装为编译期格式字符串：
+//   formatv(FORMATV_STR("{0} {1}"), 1234.412, "test");
+//   format(FORMATV_STR("%s %d"), "test", 42);
+// 格式错误或索引超出参数个数会在编译期报错。
+#define FORMATV_STR(s)                                               \
+  [] {                                                               \
+    struct FormatvString : ::Formatv::CompileString {                \
+      static constexpr auto data() -> std::string_view { return s; } \
+    };                                                               \
+    return FormatvString{};                                          \
+  }()
 
- protected:
-  virtual ~FormatAdapter() = default;
+namespace Internal {
 
- private:
-  virtual void anchor() {}
-};
+template <typename T, typename Enable = void>
+struct HasFormatProviderSize : std::false_type {};
 
-// ProviderFormatAdapter 和 StreamOperatorFormatAdapter 类: 
-// 这两个类都是FormatAdapter的具体子类。
-//
-// ProviderFormatAdapter使用FormatProvider为特定类型进行格式化，
-// 而StreamOperatorFormatAdapter则使用流插入运算符(<<)为类型进行格式化。
 template <typename T>
-class ProviderFormatAdapter : public FormatAdapter {
+struct HasFormatProviderSize<
+    T, std::enable_if_t<std::is_same_v<
+           decltype(FormatProvider<std::decay_t<T>>::formatted_size(
+               std::declval<const std::decay_t<T>&>(),
+               std::declval<std::string_view>())),
+           size_t>>> : std::true_type {};
+
+// 它是一个抽象基类，定义了一个纯虚函数format。
+// 继承它的对象可以直接作为 formatv 的参数，由对象自己完成格式化。
+class FormatAdapter {
  public:
-  explicit ProviderFormatAdapter(T&& item) : item_(std::forward<T>(item)) {}
+  virtual void format(FormatSink& os, std::string_view options) = 0;
 
-  void format(std::ostream& os, std::string options) override {
-    FormatProvider<std::decay_t<T>>::format(item_, os, options);
+  // 不实际格式化就能得知的输出长度，无法廉价得知时返回 std::nullopt。
+  virtual auto size_hint(std::string_view /*options*/)
+      -> std::optional<size_t> {
+    return std::nullopt;
   }
 
- private:
-  T item_;
-};
-
-template <typename T>
-class StreamOperatorFormatAdapter : public FormatAdapter {
- public:
-  explicit StreamOperatorFormatAdapter(T&& item)
-      : item_(std::forward<T>(item)) {}
-
-  void format(std::ostream& os, std::string /*options*/) override {
-    os << item_;
+  // 输出的精确长度，必要时格式化到 CountingSink 中计数。
+  auto formatted_size(std::string_view options) -> size_t {
+    if (auto size = size_hint(options)) {
+      return *size;
+    }
+    CountingSink sink;
+    format(sink, options);
+    return sink.count();
   }
 
+ protected:
+  virtual ~FormatAdapter() = default;
+
  private:
-  T item_;
+  virtual void anchor() {}
 };
 
-template <typename T>
-class MissingFormatAdapter;
-
 template <typename T, T>
 struct SameType;
 
 // HasFormatProvider 和 HasStreamOperator 类:
 // 这两个模板结构用于检查一个给定的类型是否有与FormatProvider或流插入运算符相关的格式化功能。
 // FormatProvider should have the signature:
-//   static void format(const T&, raw_stream &, StringRef);
+//   static void format(const T&, FormatSink&, std::string_view);
 template <class T>
 class HasFormatProvider {
  public:
   using Decayed = std::decay_t<T>;
-  using SignatureFormat = void (*)(const Decayed&, std::ostream&, std::string);
+  using SignatureFormat = void (*)(const Decayed&, FormatSink&,
+                                   std::string_view);
 
   template <typename U>
   static auto test(SameType<SignatureFormat, &U::format>*) -> char;
@@ -85,6 +109,18 @@ class HasFormatProvider {
       (sizeof(test<FormatProvider<Decayed>>(nullptr)) == 1);
 };
 
+// 旧版本格式化到 std::ostream 的 FormatProvider，选项参数为 std::string
+// 或 std::string_view。同时提供新签名时以新签名为准。
+template <typename T, typename Enable = void>
+struct HasLegacyFormatProvider : std::false_type {};
+
+template <typename T>
+struct HasLegacyFormatProvider<
+    T, std::void_t<decltype(FormatProvider<std::decay_t<T>>::format(
+           std::declval<const std::decay_t<T>&>(),
+           std::declval<std::ostream&>(), std::declval<std::string>()))>>
+    : std::integral_constant<bool, !HasFormatProvider<T>::Value> {};
+
 template <class T>
 class HasStreamOperator {
  public:
@@ -104,7 +140,7 @@ class HasStreamOperator {
 };
 
 // Uses* 结构:
-// 这些结构根据上面的检查，决定哪种适配器应该用于给定的类型。
+// 这些结构根据上面的检查，决定一个类型的参数应当如何格式化。
 template <typename T>
 struct UsesFormatMember
     : public std::integral_constant<
@@ -113,8 +149,10 @@ struct UsesFormatMember
 
 template <typename T>
 struct UsesFormatProvider
-    : public std::integral_constant<bool, !UsesFormatMember<T>::value &&
-                                              HasFormatProvider<T>::Value> {};
+    : public std::integral_constant<
+          bool, !UsesFormatMember<T>::value &&
+                    (HasFormatProvider<T>::Value ||
+                     HasLegacyFormatProvider<T>::value)> {};
 
 template <typename T>
 struct UsesStreamOperator
@@ -128,36 +166,10 @@ struct UsesMissingProvider
                                               !UsesFormatProvider<T>::value &&
                                               !HasStreamOperator<T>::Value> {};
 
-// build_format_adapter 函数模板:
-// 这是一个函数模板的重载集合，根据对象的类型选择合适的格式适配器，
-// 并将对象传递给适配器进行格式化。它使用SFINAE来选择适当的重载版本，
-// 根据对象是否满足不同的格式化要求。
-template <typename T>
-auto build_format_adapter(T&& item)
-    -> std::enable_if_t<UsesFormatMember<T>::value, T> {
-  return std::forward<T>(item);
-}
-
-template <typename T>
-auto build_format_adapter(T&& item)
-    -> std::enable_if_t<UsesFormatProvider<T>::value,
-                        ProviderFormatAdapter<T>> {
-  return ProviderFormatAdapter<T>(std::forward<T>(item));
-}
-
-template <typename T>
-auto build_format_adapter(T&& item)
-    -> std::enable_if_t<UsesStreamOperator<T>::value,
-                        StreamOperatorFormatAdapter<T>> {
-  return StreamOperatorFormatAdapter<T>(std::forward<T>(item));
-}
-
+// formatv 中参数的存储方式：左值保存引用，右值移动到 FormatvObject 中保存。
 template <typename T>
-auto build_format_adapter(T&& item)
-    -> std::enable_if_t<UsesMissingProvider<T>::value,
-                        MissingFormatAdapter<T>> {
-  return MissingFormatAdapter<T>(std::forward<T>(item));
-}
+using StoredArg = std::conditional_t<std::is_lvalue_reference_v<T>, T,
+                                     std::decay_t<T>>;
 
 }  // namespace Internal
 
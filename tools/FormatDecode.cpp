@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+
+#include "FormatBinaryLog.h"
+
+// 将 BinaryLogWriter 生成的二进制日志还原为文本：
+//   formatv_decode app.fmtvlog > app.log
+// 不指定文件时从标准输入读取。
+auto main(int argc, char** argv) -> int {
+  if (argc > 2) {
+    std::fprintf(stderr, "usage: %s [binary-log]\n", argv[0]);
+    return 2;
+  }
+
+  std::string data;
+  if (argc == 2) {
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!in) {
+      std::fprintf(stderr, "%s: cannot open %s\n", argv[0], argv[1]);
+      return 1;
+    }
+    std::ostringstream buffer;
+    buffer << in.rdbuf();
+    data = buffer.str();
+  } else {
+    data.assign(std::istreambuf_iterator<char>(std::cin),
+                std::istreambuf_iterator<char>());
+  }
+
+  Formatv::BinaryLogReader reader(data);
+  {
+    Formatv::StreamSink sink(std::cout);
+    while (reader.Next(sink)) {
+      sink.put('\n');
+    }
+  }
+  if (reader.failed()) {
+    std::fprintf(stderr, "%s: %s at offset %zu\n", argv[0], reader.error(),
+                 reader.offset());
+    return 1;
+  }
+  if (reader.skipped() != 0) {
+    std::fprintf(stderr,
+                 "%s: skipped %zu records with an invalid format string\n",
+                 argv[0], reader.skipped());
+    return 1;
+  }
+  return 0;
+}